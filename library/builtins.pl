@@ -30,7 +30,7 @@ predicate_property(P, A) :-
 predicate_property(P, A) :-
 	'$load_properties',
 	(	var(A) -> true
-	; 	(	(Controls = [built_in,control_construct,discontiguous,private,static,dynamic,persist,multifile,meta_predicate(_)],
+	; 	(	(Controls = [built_in,control_construct,discontiguous,private,static,dynamic,persist,multifile,meta_predicate(_),index(_)],
 			memberchk(A, Controls)) -> true
 		;	throw(error(domain_error(predicate_property, A), P))
 		)
@@ -404,6 +404,20 @@ atom_number(A,N) :- atom_codes(A,Codes), number_codes(N,Codes).
 '$skip_list'(Skip,Xs0,Xs) :- '$skip_max_list'(Skip,_,Xs0,Xs).
 between(I,J,K) :- '$between'(I,J,K,_).
 forall(Cond, Action) :- \+ (Cond, \+ Action).
+
+% Calls G with argument N bound in turn to each value it has in the
+% database from Lo to Hi (in the standard order), using an index...
+
+index_range(G, N, Lo, Hi) :-
+	must_be(G, callable, index_range/4, _),
+	must_be(N, integer, index_range/4, _),
+	must_be(Lo, atomic, index_range/4, _),
+	must_be(Hi, atomic, index_range/4, _),
+	'$index_range'(G, N, Lo, Hi, Ks),
+	'$index_range'(Ks, N, G).
+
+'$index_range'([K|_], N, G) :- arg(N, G, K), call(G).
+'$index_range'([_|Ks], N, G) :- '$index_range'(Ks, N, G).
 catch(G, E, C) :- '$catch'(call(G), E, call(C)).
 throw(E) :- '$throw'(E).
 once(G) :- G, !.
@@ -79,6 +79,17 @@ inline static cell *deref_var(query *q, cell *c, pl_idx_t c_ctx)
 
 #define deref(q, c, c_ctx) is_variable(c) ? deref_var(q, c, c_ctx) : (q->latest_ctx = (c_ctx), (c))
 
+// Note that frame 'ctx' is referenced from the older frame 'from_ctx',
+// so it can't be reused by a last call made from above 'from_ctx'...
+
+inline static void pin_frame(query *q, pl_idx_t ctx, pl_idx_t from_ctx)
+{
+	frame *f = GET_FRAME(ctx);
+
+	if (from_ctx < f->min_ref)
+		f->min_ref = from_ctx;
+}
+
 #define GET_FIRST_ARG(p,vt) \
 	cell *p = get_first_arg(q); \
 	pl_idx_t p##_ctx = q->latest_ctx; \
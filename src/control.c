@@ -173,6 +173,44 @@ USE_RESULT pl_status fn_iso_call_n(query *q)
 	return pl_success;
 }
 
+// Run a condition that xref found to be only type tests and
+// comparisons in place, without a choice or barrier...
+
+static pl_status do_simple_test(query *q, cell *c, pl_idx_t c_ctx)
+{
+	if ((c->val_off == g_conjunction_s) && (c->arity == 2)) {
+		pl_status ok = do_simple_test(q, c+1, c_ctx);
+
+		if (!ok || q->did_throw)
+			return ok;
+
+		return do_simple_test(q, c+1+c[1].nbr_cells, c_ctx);
+	}
+
+	cell *save = q->st.curr_cell;
+	pl_idx_t save_ctx = q->st.curr_frame;
+	q->st.curr_cell = c;
+	q->st.curr_frame = c_ctx;
+	pl_status ok = c->fn(q);
+
+	if (!q->did_throw) {
+		q->st.curr_cell = save;
+		q->st.curr_frame = save_ctx;
+	}
+
+	return ok;
+}
+
+static pl_status do_branch(query *q, cell *p1)
+{
+	cell *tmp = clone_to_heap(q, true, p1, 1);
+	may_heap_error(tmp);
+	pl_idx_t nbr_cells = 1 + p1->nbr_cells;
+	make_return(q, tmp+nbr_cells);
+	q->st.curr_cell = tmp;
+	return pl_success;
+}
+
 // if -> then
 
 USE_RESULT pl_status fn_iso_if_then_2(query *q)
@@ -182,6 +220,16 @@ USE_RESULT pl_status fn_iso_if_then_2(query *q)
 
 	GET_FIRST_ARG(p1,callable);
 	GET_NEXT_ARG(p2,callable);
+
+	if ((p1->flags & FLAG_SIMPLE_TEST) && !q->trace) {
+		pl_status ok = do_simple_test(q, p1, p1_ctx);
+
+		if (!ok || q->did_throw)
+			return ok;
+
+		return do_branch(q, p2);
+	}
+
 	cell *tmp = clone_to_heap(q, true, p1, 1+p2->nbr_cells+1);
 	may_heap_error(tmp);
 	pl_idx_t nbr_cells = 1 + p1->nbr_cells;
@@ -217,13 +265,16 @@ USE_RESULT pl_status fn_if_2(query *q)
 
 static pl_status do_if_then_else(query *q, cell *p1, cell *p2, cell *p3)
 {
-	if (q->retry) {
-		cell *tmp = clone_to_heap(q, true, p3, 1);
-		may_heap_error(tmp);
-		pl_idx_t nbr_cells = 1 + p3->nbr_cells;
-		make_return(q, tmp+nbr_cells);
-		q->st.curr_cell = tmp;
-		return pl_success;
+	if (q->retry)
+		return do_branch(q, p3);
+
+	if ((p1->flags & FLAG_SIMPLE_TEST) && !q->trace) {
+		pl_status ok = do_simple_test(q, p1, q->st.curr_frame);
+
+		if (q->did_throw || q->is_oom)
+			return ok;
+
+		return do_branch(q, ok ? p2 : p3);
 	}
 
 	cell *tmp = clone_to_heap(q, true, p1, 1+p2->nbr_cells+1);
@@ -556,7 +556,7 @@ static USE_RESULT pl_status fn_iso_stream_property_2(query *q)
 		return pl_failure;
 	}
 
-	clause *r = &q->st.curr_clause2->cl;
+	clause *r = &q->aux.curr_clause2->cl;
 	GET_FIRST_ARG(pstrx,smallint);
 	pstrx->flags |= FLAG_INT_STREAM | FLAG_INT_HEX;
 	stash_me(q, r, false);
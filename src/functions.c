@@ -230,6 +230,101 @@ pl_status call_userfun(query *q, cell *c, pl_idx_t c_ctx)
 	return ok;
 }
 
+static USE_RESULT pl_status fn_iso_negative_1(query *q);
+static USE_RESULT pl_status fn_iso_sub_2(query *q);
+static USE_RESULT pl_status fn_iso_mul_2(query *q);
+static USE_RESULT pl_status fn_iso_divint_2(query *q);
+static USE_RESULT pl_status fn_iso_rem_2(query *q);
+
+// An expression flagged FLAG_INT_EXPR when its clause was cross-referenced
+// only uses + - * // rem and negation on integers and variables. It is
+// worked out here on small integers straight off the cells, with no call
+// per node. A variable bound to anything but a small integer, an overflow
+// or a zero divisor gives up, so eval() can redo it in full (going to a
+// bigint or raising the error)...
+
+static bool eval_int_expr(query *q, cell *c, pl_idx_t c_ctx, pl_int_t *v)
+{
+	if (is_variable(c)) {
+		c = deref_var(q, c, c_ctx);
+
+		if (!is_smallint(c))
+			return false;
+
+		*v = c->val_int;
+		return true;
+	}
+
+	if (is_smallint(c)) {
+		*v = c->val_int;
+		return true;
+	}
+
+	if (!is_function(c) || !c->arity)
+		return false;
+
+	pl_int_t v1, v2;
+	cell *c1 = c + 1;
+
+	if (!eval_int_expr(q, c1, c_ctx, &v1))
+		return false;
+
+	if (c->arity == 1) {
+		if ((c->fn != fn_iso_negative_1) || (v1 == PL_INT_MIN))
+			return false;
+
+		*v = -v1;
+		return true;
+	}
+
+	if (!eval_int_expr(q, c1 + c1->nbr_cells, c_ctx, &v2))
+		return false;
+
+	if (c->fn == fn_iso_add_2)
+		return !__builtin_add_overflow(v1, v2, v);
+
+	if (c->fn == fn_iso_sub_2)
+		return !__builtin_sub_overflow(v1, v2, v);
+
+	if (c->fn == fn_iso_mul_2)
+		return !__builtin_mul_overflow(v1, v2, v);
+
+	if ((v2 == 0) || (v2 == -1))
+		return false;
+
+	if (c->fn == fn_iso_divint_2) {
+		*v = v1 / v2;
+		return true;
+	}
+
+	if (c->fn == fn_iso_rem_2) {
+		*v = v1 % v2;
+		return true;
+	}
+
+	return false;
+}
+
+static bool eval_int_arg(query *q, int n, pl_int_t *v)
+{
+	cell *c = get_raw_arg(q, n);
+
+	if (!(c->flags & FLAG_INT_EXPR))
+		return false;
+
+	return eval_int_expr(q, c, q->st.curr_frame, v);
+}
+
+// Compare two arithmetic args if both are small integer expressions,
+// else fall through to the general code...
+
+#define INT_COMPARE(op) {										\
+	pl_int_t v1, v2;											\
+																\
+	if (eval_int_arg(q, 1, &v1) && eval_int_arg(q, 2, &v2))		\
+		return v1 op v2;										\
+}
+
 static USE_RESULT pl_status fn_return_1(query *q)
 {
 	GET_FIRST_ARG(p1_tmp,any);
@@ -245,6 +340,25 @@ static USE_RESULT pl_status fn_return_1(query *q)
 static USE_RESULT pl_status fn_iso_is_2(query *q)
 {
 	GET_FIRST_ARG(p1,any);
+	pl_int_t v;
+
+	if (eval_int_arg(q, 2, &v)) {
+		if (is_variable(p1)) {
+			cell tmp;
+			make_int(&tmp, v);
+			set_var(q, p1, p1_ctx, &tmp, q->st.curr_frame);
+			return pl_success;
+		}
+
+		if (is_smallint(p1))
+			return p1->val_int == v;
+
+		if (is_bigint(p1))
+			return !mp_int_compare_value(&p1->val_bigint->ival, v);
+
+		return pl_failure;
+	}
+
 	GET_NEXT_ARG(p2_tmp,any);
 	CLEANUP cell p2 = eval(q, p2_tmp);
 	p2.nbr_cells = 1;
@@ -2115,6 +2229,7 @@ static USE_RESULT pl_status fn_iso_sge_2(query *q)
 
 static USE_RESULT pl_status fn_iso_neq_2(query *q)
 {
+	INT_COMPARE(==);
 	GET_FIRST_ARG(p1_tmp,any);
 	GET_NEXT_ARG(p2_tmp,any);
 	CLEANUP cell p1 = eval(q, p1_tmp);
@@ -2140,6 +2255,7 @@ static USE_RESULT pl_status fn_iso_neq_2(query *q)
 
 static USE_RESULT pl_status fn_iso_nne_2(query *q)
 {
+	INT_COMPARE(!=);
 	GET_FIRST_ARG(p1_tmp,any);
 	GET_NEXT_ARG(p2_tmp,any);
 	CLEANUP cell p1 = eval(q, p1_tmp);
@@ -2165,6 +2281,7 @@ static USE_RESULT pl_status fn_iso_nne_2(query *q)
 
 static USE_RESULT pl_status fn_iso_nge_2(query *q)
 {
+	INT_COMPARE(>=);
 	GET_FIRST_ARG(p1_tmp,any);
 	GET_NEXT_ARG(p2_tmp,any);
 	CLEANUP cell p1 = eval(q, p1_tmp);
@@ -2190,6 +2307,7 @@ static USE_RESULT pl_status fn_iso_nge_2(query *q)
 
 static USE_RESULT pl_status fn_iso_ngt_2(query *q)
 {
+	INT_COMPARE(>);
 	GET_FIRST_ARG(p1_tmp,any);
 	GET_NEXT_ARG(p2_tmp,any);
 	CLEANUP cell p1 = eval(q, p1_tmp);
@@ -2215,6 +2333,7 @@ static USE_RESULT pl_status fn_iso_ngt_2(query *q)
 
 static USE_RESULT pl_status fn_iso_nle_2(query *q)
 {
+	INT_COMPARE(<=);
 	GET_FIRST_ARG(p1_tmp,any);
 	GET_NEXT_ARG(p2_tmp,any);
 	CLEANUP cell p1 = eval(q, p1_tmp);
@@ -2240,6 +2359,7 @@ static USE_RESULT pl_status fn_iso_nle_2(query *q)
 
 static USE_RESULT pl_status fn_iso_nlt_2(query *q)
 {
+	INT_COMPARE(<);
 	GET_FIRST_ARG(p1_tmp,any);
 	GET_NEXT_ARG(p2_tmp,any);
 	CLEANUP cell p1 = eval(q, p1_tmp);
@@ -2490,7 +2610,7 @@ static USE_RESULT pl_status fn_sys_set_prob_1(query *q)
 	if (p > 1.0)
 		return throw_error(q, p1, p1_ctx, "domain_error", "range_error");
 
-	q->st.prob *= p;
+	q->aux.prob *= p;
 	return pl_success;
 }
 
@@ -2498,9 +2618,9 @@ static USE_RESULT pl_status fn_sys_get_prob_1(query *q)
 {
 	GET_FIRST_ARG(p1,variable);
 	cell tmp;
-	make_real(&tmp, q->st.prob);
+	make_real(&tmp, q->aux.prob);
 	set_var(q, p1, p1_ctx, &tmp, q->st.curr_frame);
-	q->st.prob = 1.0;
+	q->aux.prob = 1.0;
 	return pl_success;
 }
 
@@ -4,6 +4,11 @@
 #include <ctype.h>
 #include <errno.h>
 
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
 #include "internal.h"
 #include "query.h"
 #include "heap.h"
@@ -40,6 +45,107 @@ size_t alloc_grow(void **addr, size_t elem_size, size_t min_elements, size_t max
 	return elements;
 }
 
+// The engine stacks (frames, slots, choices & trail) reserve address
+// space for 'max_elements' up front and commit it as they grow, so
+// growing never copies or moves them and the OS only provides the
+// pages actually touched. Where the reservation can't be made they
+// fall back to realloc() with '*reserved' set to zero...
+
+#ifndef _WIN32
+static size_t page_round(size_t n)
+{
+	static size_t s_page_size = 0;
+
+	if (!s_page_size)
+		s_page_size = sysconf(_SC_PAGESIZE);
+
+	return (n + s_page_size - 1) / s_page_size * s_page_size;
+}
+#endif
+
+void *stack_alloc(size_t elem_size, size_t nbr_elements, size_t max_elements, size_t *reserved)
+{
+	*reserved = 0;
+
+#ifndef _WIN32
+	size_t len = page_round(elem_size * max_elements);
+	void *addr = mmap(NULL, len, PROT_NONE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
+
+	if (addr != MAP_FAILED) {
+		if (!mprotect(addr, page_round(elem_size * nbr_elements), PROT_READ|PROT_WRITE)) {
+			*reserved = max_elements;
+			return addr;
+		}
+
+		munmap(addr, len);
+	}
+#endif
+
+	return calloc(nbr_elements, elem_size);
+}
+
+size_t stack_grow(void **addr, size_t elem_size, size_t min_elements, size_t max_elements, size_t reserved)
+{
+	if (!reserved)
+		return alloc_grow(addr, elem_size, min_elements, max_elements);
+
+#ifndef _WIN32
+	if (max_elements > reserved)
+		max_elements = reserved;
+
+	if (min_elements > max_elements)
+		return 0;
+
+	size_t len = page_round(elem_size * max_elements);
+
+	if (mprotect(*addr, len, PROT_READ|PROT_WRITE))
+		return 0;
+
+	size_t elements = len / elem_size;
+	return elements < reserved ? elements : reserved;
+#else
+	return 0;
+#endif
+}
+
+// Give back to the OS the pages past the first 'keep_elements',
+// returning the new (committed) number of elements...
+
+size_t stack_trim(void *addr, size_t elem_size, size_t nbr_elements, size_t keep_elements, size_t reserved)
+{
+	if (!reserved || (keep_elements >= nbr_elements))
+		return nbr_elements;
+
+#ifndef _WIN32
+	size_t start = page_round(elem_size * keep_elements);
+	size_t end = page_round(elem_size * nbr_elements);
+
+	if (start >= end)
+		return nbr_elements;
+
+	madvise((char*)addr + start, end - start, MADV_DONTNEED);
+	mprotect((char*)addr + start, end - start, PROT_NONE);
+	return start / elem_size;
+#else
+	return nbr_elements;
+#endif
+}
+
+void stack_free(void *addr, size_t elem_size, size_t reserved)
+{
+	if (!addr)
+		return;
+
+#ifndef _WIN32
+	if (reserved) {
+		munmap(addr, page_round(elem_size * reserved));
+		return;
+	}
+#endif
+
+	free(addr);
+}
+
 // The tmp heap is used for temporary allocations (a scratch-pad)
 // for work in progress. As such it can survive a realloc() call.
 
@@ -77,34 +183,142 @@ cell *alloc_on_tmp(query *q, pl_idx_t nbr_cells)
 // done as it will invalidate existing pointers. Build any compounds
 // first on the tmp heap, then allocate in one go here and copy in.
 // When more space is need allocate a new page and keep them in the
-// page list. Backtracking will garbage collect and free as needed.
+// page list. Backtracking will garbage collect and free as needed,
+// as will gc_heap() when enough pages have been added since it last
+// ran...
+
+static const unsigned MIN_GC_PAGES = 8;
+
+static void count_page(query *q)
+{
+	q->nbr_pages++;
+
+	if ((q->nbr_pages >= MIN_GC_PAGES) && (q->nbr_pages >= q->gc_pages))
+		q->gc_due = true;
+}
+
+// Pages let go of are kept on a short free list to be used again.
+// The cells they used were set to TAG_EMPTY when unshared, and those
+// past 'max_hp_used' are still zero from calloc(), so a page can be
+// handed out again without clearing it. A page much bigger than the
+// query's page size (made for one large term) isn't kept...
+
+static const unsigned MAX_FREE_PAGES = 8;
+static const pl_idx_t MAX_PAGE_CELLS = 1024 * 128;
+
+static page *new_page(query *q, pl_idx_t nbr_cells)
+{
+	pl_idx_t n = MAX_OF(q->h_size, nbr_cells);
+
+	for (page **ptr = &q->free_pages; *ptr;) {
+		page *a = *ptr;
+
+		if (a->h_size >= n) {
+			*ptr = a->next;
+			q->nbr_free_pages--;
+			q->tot_pages_reused++;
+			return a;
+		}
+
+		// Kept from before the page size went up...
+
+		if (a->h_size < q->h_size) {
+			*ptr = a->next;
+			q->nbr_free_pages--;
+			free(a->heap);
+			free(a);
+			continue;
+		}
+
+		ptr = &a->next;
+	}
+
+	page *a = calloc(1, sizeof(page));
+	if (!a) return NULL;
+	a->heap = calloc(a->h_size=n, sizeof(cell));
+	if (!a->heap) { free(a); return NULL; }
+	q->tot_pages_new++;
+	return a;
+}
+
+static void release_page(query *q, page *a)
+{
+	for (pl_idx_t i = 0; i < a->max_hp_used; i++) {
+		cell *c = a->heap + i;
+		unshare_cell(c);
+		c->tag = TAG_EMPTY;
+		c->attrs = NULL;
+	}
+
+	q->nbr_pages--;
+
+	if ((q->nbr_free_pages < MAX_FREE_PAGES)
+		&& (a->h_size >= q->h_size) && (a->h_size <= (q->h_size * 4))) {
+		a->hp = a->max_hp_used = 0;
+		a->mark = false;
+		a->next = q->free_pages;
+		q->free_pages = a;
+		q->nbr_free_pages++;
+		return;
+	}
+
+	free(a->heap);
+	free(a);
+}
+
+// On backtracking drop the pages made since the choice. If more than
+// one went and together they had more cells in use than a page holds,
+// each pass over this part of the search outgrows a page, so later
+// pages are made bigger (up to MAX_PAGE_CELLS)...
+
+void trim_pages(query *q, unsigned curr_page)
+{
+	pl_idx_t used = 0;
+	unsigned cnt = 0;
+
+	while (q->pages && (q->pages->nbr >= curr_page)) {
+		page *a = q->pages;
+		q->pages = a->next;
+		used += a->max_hp_used;
+		release_page(q, a);
+		cnt++;
+	}
+
+	if ((cnt < 2) || (used <= q->h_size))
+		return;
+
+	while ((q->h_size < used) && (q->h_size < MAX_PAGE_CELLS))
+		q->h_size *= 2;
+
+	if (q->h_size > MAX_PAGE_CELLS)
+		q->h_size = MAX_PAGE_CELLS;
+}
+
+void free_pages(query *q)
+{
+	while (q->free_pages) {
+		page *a = q->free_pages;
+		q->free_pages = a->next;
+		free(a->heap);
+		free(a);
+	}
+
+	q->nbr_free_pages = 0;
+}
 
 cell *alloc_on_heap(query *q, pl_idx_t nbr_cells)
 {
 	if (((uint64_t)q->st.hp + nbr_cells) > UINT32_MAX)
 		return NULL;
 
-	if (!q->pages) {
-		page *a = calloc(1, sizeof(page));
+	if (!q->pages || ((q->st.hp + nbr_cells) >= q->pages->h_size)) {
+		page *a = new_page(q, nbr_cells);
 		if (!a) return NULL;
 		a->next = q->pages;
-		unsigned n = MAX_OF(q->h_size, nbr_cells);
-		a->heap = calloc(a->h_size=n, sizeof(cell));
-		if (!a->heap) { free(a); return NULL; }
-		a->nbr = q->st.curr_page++;
-		q->pages = a;
-	}
-
-	if ((q->st.hp + nbr_cells) >= q->pages->h_size) {
-		page *a = calloc(1, sizeof(page));
-		if (!a) return NULL;
-		a->next = q->pages;
-		unsigned n = MAX_OF(q->h_size, nbr_cells);
-		a->heap = calloc(a->h_size=n, sizeof(cell));
-		if (!a->heap) { free(a); return NULL; }
 		a->nbr = q->st.curr_page++;
 		q->pages = a;
 		q->st.hp = 0;
+		count_page(q);
 	}
 
 	cell *c = q->pages->heap + q->st.hp;
@@ -117,6 +331,185 @@ cell *alloc_on_heap(query *q, pl_idx_t nbr_cells)
 	return c;
 }
 
+// Pages are collected whole, a page being live if it is pointed to
+// from the query itself, its frames, slots, choices, trail or queues,
+// or from a live page. As cells hold pointers in different places
+// for different tags (and C code may keep others in the query) every
+// word is taken as a possible pointer, so a stray integer may keep a
+// page, but a page in use can't be lost. This is only safe between
+// goals (see start), when nothing else refers to the heap. The page
+// being allocated from is always kept, as is the one each choice will
+// carry on allocating from when backtracked to. Tasks may bind their
+// variables to terms on their parent's heap, so a query with tasks
+// isn't collected.
+
+typedef struct {
+	page **pages, **stack;
+	unsigned nbr, sp;
+} heap_gc;
+
+static int page_cmp(const void *ptr1, const void *ptr2)
+{
+	const page *a1 = *(const page**)ptr1;
+	const page *a2 = *(const page**)ptr2;
+
+	if (a1->heap < a2->heap)
+		return -1;
+
+	if (a1->heap > a2->heap)
+		return 1;
+
+	return 0;
+}
+
+static void mark_page(heap_gc *gc, page *a)
+{
+	if (a->mark)
+		return;
+
+	a->mark = true;
+	gc->stack[gc->sp++] = a;
+}
+
+static void mark_words(heap_gc *gc, const void *ptr, size_t nbytes)
+{
+	const page *last = gc->pages[gc->nbr-1];
+	const uintptr_t lo = (uintptr_t)gc->pages[0]->heap;
+	const uintptr_t hi = (uintptr_t)(last->heap + last->h_size);
+	const uintptr_t *w = ptr;
+
+	for (size_t n = nbytes / sizeof(uintptr_t); n--; w++) {
+		if ((*w < lo) || (*w > hi))
+			continue;
+
+		unsigned lo_idx = 0, hi_idx = gc->nbr;
+
+		while ((hi_idx - lo_idx) > 1) {
+			unsigned mid = (lo_idx + hi_idx) / 2;
+
+			if ((uintptr_t)gc->pages[mid]->heap <= *w)
+				lo_idx = mid;
+			else
+				hi_idx = mid;
+		}
+
+		page *a = gc->pages[lo_idx];
+
+		if (*w <= (uintptr_t)(a->heap + a->h_size))
+			mark_page(gc, a);
+	}
+}
+
+static bool has_tasks(const query *q)
+{
+	for (const module *m = q->pl->modules; m; m = m->next) {
+		for (const query *task = m->tasks; task; task = task->next) {
+			if (task->parent == q)
+				return true;
+		}
+	}
+
+	return false;
+}
+
+static void mark_roots(query *q, heap_gc *gc)
+{
+	pl_idx_t fp = q->st.fp, sp = q->st.sp;
+	page *a = q->pages;
+	mark_page(gc, a);
+
+	for (pl_idx_t i = q->cp; i--;) {
+		const choice *ch = GET_CHOICE(i);
+
+		while (a && (a->nbr > ch->st.curr_page))
+			a = a->next;
+
+		for (page *a2 = a; a2 && ((a2->nbr + 1) >= ch->st.curr_page); a2 = a2->next)
+			mark_page(gc, a2);
+
+		if (ch->st.fp > fp)
+			fp = ch->st.fp;
+
+		if (ch->st.sp > sp)
+			sp = ch->st.sp;
+	}
+
+	mark_words(gc, q, sizeof(query));
+	mark_words(gc, q->frames, sizeof(frame) * (fp < q->frames_size ? fp : q->frames_size));
+	mark_words(gc, q->slots, sizeof(slot) * (sp < q->slots_size ? sp : q->slots_size));
+	mark_words(gc, q->choices, sizeof(choice) * q->cp);
+	mark_words(gc, q->trails, sizeof(trail) * q->st.tp);
+
+	if (q->tmp_heap)
+		mark_words(gc, q->tmp_heap, sizeof(cell) * q->tmphp);
+
+	for (int i = 0; i < MAX_QUEUES; i++) {
+		if (q->queue[i])
+			mark_words(gc, q->queue[i], sizeof(cell) * q->qp[i]);
+
+		if (q->tmpq[i])
+			mark_words(gc, q->tmpq[i], sizeof(cell) * q->tmpq_size[i]);
+	}
+}
+
+void gc_heap(query *q)
+{
+	q->gc_due = false;
+
+	if (!q->pages || has_tasks(q)) {
+		q->gc_pages = q->nbr_pages * 2;
+		return;
+	}
+
+	uint64_t started = cpu_time_in_usec();
+	heap_gc gc = {0};
+
+	for (page *a = q->pages; a; a = a->next)
+		gc.nbr++;
+
+	gc.pages = malloc(sizeof(page*) * gc.nbr);
+	gc.stack = malloc(sizeof(page*) * gc.nbr);
+
+	if (!gc.pages || !gc.stack) {
+		free(gc.pages);
+		free(gc.stack);
+		return;
+	}
+
+	unsigned i = 0;
+
+	for (page *a = q->pages; a; a = a->next)
+		gc.pages[i++] = a;
+
+	qsort(gc.pages, gc.nbr, sizeof(page*), page_cmp);
+	mark_roots(q, &gc);
+
+	while (gc.sp) {
+		const page *a = gc.stack[--gc.sp];
+		mark_words(&gc, a->heap, sizeof(cell) * a->max_hp_used);
+	}
+
+	for (page **a = &q->pages; *a;) {
+		page *save = *a;
+
+		if (save->mark) {
+			save->mark = false;
+			a = &save->next;
+			continue;
+		}
+
+		*a = save->next;
+		q->tot_gc_cells += save->h_size;
+		release_page(q, save);
+	}
+
+	free(gc.pages);
+	free(gc.stack);
+	q->gc_pages = q->nbr_pages * 2;
+	q->tot_gcs++;
+	q->gc_time += cpu_time_in_usec() - started;
+}
+
 bool is_in_ref_list(cell *c, pl_idx_t c_ctx, reflist *rlist)
 {
 	while (rlist) {
@@ -143,6 +536,26 @@ static bool is_in_ref_list2(cell *c, pl_idx_t c_ctx, reflist *rlist)
 	return false;
 }
 
+// A var's attributes don't fit in a cell, so note them here until
+// the copy's vars are created...
+
+static bool save_tmp_attrs(query *q, unsigned var_nbr, cell *attrs, pl_idx_t ctx)
+{
+	if (q->tmp_attrs_cnt == q->tmp_attrs_size) {
+		pl_idx_t new_size = q->tmp_attrs_size ? q->tmp_attrs_size * 2 : 16;
+		void *mem = realloc(q->tmp_attrs, sizeof(*q->tmp_attrs) * new_size);
+		if (!mem) return false;
+		q->tmp_attrs = mem;
+		q->tmp_attrs_size = new_size;
+	}
+
+	q->tmp_attrs[q->tmp_attrs_cnt].attrs = attrs;
+	q->tmp_attrs[q->tmp_attrs_cnt].ctx = ctx;
+	q->tmp_attrs[q->tmp_attrs_cnt].var_nbr = var_nbr;
+	q->tmp_attrs_cnt++;
+	return true;
+}
+
 // FIXME: rewrite this using efficient sweep/mark methodology...
 
 static cell *deep_copy2_to_tmp(query *q, cell *p1, pl_idx_t p1_ctx, bool copy_attrs, unsigned depth, reflist *list)
@@ -183,9 +596,9 @@ static cell *deep_copy2_to_tmp(query *q, cell *p1, pl_idx_t p1_ctx, bool copy_at
 		tmp->var_nbr = var_nbr;
 		tmp->flags = FLAG_VAR_FRESH;
 
-		if (copy_attrs) {
-			tmp->tmp_attrs = e->c.attrs;
-			tmp->tmp_ctx = e->c.attrs_ctx;
+		if (copy_attrs && e->c.attrs) {
+			if (!save_tmp_attrs(q, var_nbr, e->c.attrs, e->c.attrs_ctx))
+				return NULL;
 		}
 
 		if (is_anon(p1))
@@ -218,7 +631,6 @@ static cell *deep_copy2_to_tmp(query *q, cell *p1, pl_idx_t p1_ctx, bool copy_at
 				*tmp = *h;
 				tmp->var_nbr = q->tab0_varno;
 				tmp->flags |= FLAG_VAR_FRESH;
-				tmp->tmp_attrs = NULL;
 			} else {
 				reflist nlist = {0};
 				nlist.next = list;
@@ -246,7 +658,6 @@ static cell *deep_copy2_to_tmp(query *q, cell *p1, pl_idx_t p1_ctx, bool copy_at
 				tmp->val_off = g_anon_s;
 				tmp->var_nbr = q->tab0_varno;
 				tmp->flags |= FLAG_VAR_FRESH;
-				tmp->tmp_attrs = NULL;
 				cyclic = true;
 				break;
 			}
@@ -283,7 +694,6 @@ static cell *deep_copy2_to_tmp(query *q, cell *p1, pl_idx_t p1_ctx, bool copy_at
 				*tmp = *p1;
 				tmp->var_nbr = q->tab0_varno;
 				tmp->flags |= FLAG_VAR_FRESH;
-				tmp->tmp_attrs = NULL;
 			} else {
 				nlist.next = list;
 				nlist.ptr = save_p1;
@@ -346,6 +756,7 @@ static cell *deep_copy_to_tmp_with_replacement(query *q, cell *p1, pl_idx_t p1_c
 	frame *f = GET_CURR_FRAME();
 	q->varno = f->nbr_vars;
 	q->tab_idx = 0;
+	q->tmp_attrs_cnt = 0;
 	ensure(q->vars = m_create(NULL, NULL, NULL));
 	q->cycle_error = false;
 	int nbr_vars = f->nbr_vars;
@@ -409,14 +820,13 @@ static cell *deep_copy_to_tmp_with_replacement(query *q, cell *p1, pl_idx_t p1_c
 	if (!copy_attrs)
 		return get_tmp_heap_start(q);
 
-	c = get_tmp_heap_start(q);
+	f = GET_CURR_FRAME();
 
-	for (pl_idx_t i = 0; i < rec->nbr_cells; i++, c++) {
-		if (is_variable(c) && is_fresh(c) && c->tmp_attrs) {
-			slot *e = GET_SLOT(f, c->var_nbr);
-			e->c.attrs = c->tmp_attrs;
-			e->c.attrs_ctx = c->tmp_ctx;
-		}
+	for (pl_idx_t i = 0; i < q->tmp_attrs_cnt; i++) {
+		slot *e = GET_SLOT(f, q->tmp_attrs[i].var_nbr);
+		e->c.attrs = q->tmp_attrs[i].attrs;
+		e->c.attrs_ctx = q->tmp_attrs[i].ctx;
+		pin_frame(q, q->tmp_attrs[i].ctx, q->st.curr_frame);
 	}
 
 	return get_tmp_heap_start(q);
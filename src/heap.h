@@ -1,6 +1,10 @@
 #pragma once
 
 USE_RESULT size_t alloc_grow(void **addr, size_t elem_size, size_t min_elements, size_t max_elements);
+USE_RESULT void *stack_alloc(size_t elem_size, size_t nbr_elements, size_t max_elements, size_t *reserved);
+USE_RESULT size_t stack_grow(void **addr, size_t elem_size, size_t min_elements, size_t max_elements, size_t reserved);
+size_t stack_trim(void *addr, size_t elem_size, size_t nbr_elements, size_t keep_elements, size_t reserved);
+void stack_free(void *addr, size_t elem_size, size_t reserved);
 
 USE_RESULT cell *clone2_to_tmp(query *q, cell *p1);
 USE_RESULT cell *clone_to_tmp(query *q, cell *p1);
@@ -16,6 +20,9 @@ USE_RESULT cell *deep_copy_to_heap_with_replacement(query *q, cell *p1, pl_idx_t
 USE_RESULT cell *deep_raw_copy_to_tmp(query *q, cell *p1, pl_idx_t p1_ctx);
 
 USE_RESULT cell *alloc_on_heap(query *q, pl_idx_t nbr_cells);
+void trim_pages(query *q, unsigned curr_page);
+void free_pages(query *q);
+void gc_heap(query *q);
 USE_RESULT cell *alloc_on_tmp(query *q, pl_idx_t nbr_cells);
 USE_RESULT cell *alloc_on_queuen(query *q, int qnbr, const cell *c);
 
@@ -196,7 +196,7 @@ typedef struct {
 	)
 
 #define _LEN_STR(pl,c) 											\
-	( !is_cstring(c) ? strlen((pl)->pool + (c)->val_off)		\
+	( !is_cstring(c) ? ATOM_LEN(pl, (c)->val_off)				\
 	: is_strbuf(c) ? (c)->strb_len								\
 	: is_static(c) ? (c)->str_len								\
 	: (c)->chr_len												\
@@ -207,7 +207,7 @@ typedef struct {
 #define _CMP_SLICES(pl,c1,c2) slicecmp(_GET_STR(pl, c1), _LEN_STR(pl, c1), _GET_STR(pl, c2), _LEN_STR(pl, c2))
 #define _DUP_SLICE(pl,c) slicedup(_GET_STR(pl, c), _LEN_STR(pl, c))
 
-#define LEN_STR_UTF8(c) substrlen_utf8(GET_STR(q, c), LEN_STR(q, c))
+#define LEN_STR_UTF8(c) (!is_cstring(c) ? ATOM_LEN_UTF8(q->pl, (c)->val_off) : substrlen_utf8(GET_STR(q, c), LEN_STR(q, c)))
 #define GET_STR(x,c) _GET_STR((x)->pl, c)
 #define LEN_STR(x,c) _LEN_STR((x)->pl, c)
 #define GET_POOL(x,off) ((x)->pl->pool + (off))
@@ -245,8 +245,8 @@ enum {
 	FLAG_VAR_TEMPORARY=1<<3,			// used with TAG_VAR
 	FLAG_VAR_REF=1<<4,					// used with TAG_VAR
 
-	FLAG_SPARE1=1<<6,
-	FLAG_SPARE2=1<<7,
+	FLAG_SIMPLE_TEST=1<<6,				// a condition that can't bind or leave choices
+	FLAG_INT_EXPR=1<<7,					// arithmetic on small integers only
 	FLAG_BUILTIN=1<<8,
 	FLAG_STATIC=1<<9,
 	FLAG_MANAGED=1<<10,					// any reflist-counted object
@@ -300,6 +300,7 @@ typedef struct page_ page;
 typedef struct stream_ stream;
 typedef struct slot_ slot;
 typedef struct choice_ choice;
+typedef struct choice_aux_ choice_aux;
 typedef struct prolog_state_ prolog_state;
 typedef struct prolog_flags_ prolog_flags;
 typedef struct cycle_info_ cycle_info;
@@ -309,7 +310,8 @@ typedef struct reflist_ reflist;
 // basically what a Term is. A compound is a variable length array of
 // cells, the length specified by 'nbr_cells' field in the 1st cell.
 // A cell is a tagged union.
-// The size should be 24 bytes (oops, now it is 32 bytes)
+// The size is 24 bytes: keep every variant of the union to 16 bytes,
+// anything wider (like a var's attributes in copy_term) goes elsewhere.
 
 struct cell_ {
 	uint8_t tag;
@@ -319,7 +321,7 @@ struct cell_ {
 
 	union {
 
-		void *val_dummy[3];
+		void *val_dummy[2];
 
 		struct {
 			pl_int_t val_int;
@@ -364,12 +366,7 @@ struct cell_ {
 				pl_status (*fn)(query*);
 				predicate *match;
 				uint16_t priority;		// used in parsing operators
-
-				struct {
-					cell *tmp_attrs;	// used with TAG_VAR in copy_term
-					pl_idx_t tmp_ctx;	// used with TAG_VAR in copy_term
-					pl_idx_t ref_ctx;	// used with TAG_VAR & refs
-				};
+				pl_idx_t ref_ctx;		// used with TAG_VAR & refs
 			};
 
 			uint32_t val_off;			// used with TAG_VAR & TAG_LITERAL
@@ -413,14 +410,74 @@ struct db_entry_ {
 	clause cl;
 };
 
+// Clause records are carved from slabs, one set of slabs for each
+// size class (a multiple of SLAB_CLASS_CELLS cells). Every record is
+// preceded by a pointer to its slab, NULL for a large record that was
+// allocated on its own. A slab is on its class's 'partial' list while
+// it has free records, else on the 'full' list, and is given back once
+// empty unless it is the only partial slab left...
+
+typedef struct db_slab_ db_slab;
+
+struct db_slab_ {
+	db_slab *prev, *next;
+	char *free;
+	unsigned cls, used, nbr;
+};
+
+#define SLAB_SIZE (64*1024)
+#define SLAB_CLASS_CELLS 1
+#define MAX_SLAB_CLASSES 64
+
+// A switch index on one argument (the first, or another one built
+// just in time). Clauses are hashed on the name/arity or value of
+// the argument, each key holding a run of
+// its clauses in database order. Clauses with a variable (or an
+// unhashable) argument go in the 'vars' run, which is merged back
+// with the key's run when iterating. Static predicates have it
+// built by xref_db, dynamic ones have it maintained on assert and
+// when erased clauses are finally unlinked. For long runs of one
+// name/arity an ordered index (a map from ground argument to run) is
+// also built on demand, with the rest of the clauses in 'open'. If
+// the argument isn't ground a long run can instead be split by a sub
+// switch on the compound's first argument (or the head of a list),
+// which also holds the clauses from 'vars' in its own 'vars'...
+
+typedef struct {
+	db_entry **dbes;
+	const cell *key;
+	pl_idx_t nbr, size, off, first;
+} db_run;
+
+typedef struct db_switch_ db_switch;
+
+typedef struct {
+	uint64_t val;
+	uint32_t kind;
+	bool no_sub;
+	db_run *run;
+	db_switch *sub;
+} db_key;
+
+
+struct db_switch_ {
+	db_switch *next;
+	db_key *keys;
+	map *tree;
+	db_run vars, open;
+	pl_idx_t nbr_keys, nbr_subs, size;
+	unsigned arg;
+	bool is_sub;
+};
+
 struct predicate_ {
 	predicate *prev, *next;
 	db_entry *head, *tail;
 	module *m;
-	map *idx, *idx_save;
+	db_switch *sw, *jit, *stale_sw;
 	db_entry *dirty_list;
 	cell key;
-	uint64_t cnt, ref_cnt, db_id;
+	uint64_t cnt, ref_cnt, db_id, jit_tried, jit_cnt, index_args;
 	bool is_prebuilt:1;
 	bool is_public:1;
 	bool is_dynamic:1;
@@ -465,7 +522,7 @@ struct frame_ {
 	cell *prev_cell;
 	module *m;
 	uint64_t ugen;
-	pl_idx_t prev_frame, base_slot_nbr, overflow;
+	pl_idx_t prev_frame, base_slot_nbr, overflow, min_ref;
 	uint32_t nbr_slots, nbr_vars, cgen;
 	bool is_complex:1;
 	bool is_last:1;
@@ -498,37 +555,55 @@ struct stream_ {
 
 struct prolog_state_ {
 	cell *curr_cell;
-	db_entry *curr_clause, *curr_clause2;
-	miter *f_iter;
-	predicate *pr, *pr2;
+	db_entry *curr_clause;
+	predicate *pr;
 	module *m;
-	miter *iter;
-	double prob;
+	const db_run *run1, *run2;
+	pl_idx_t run1_pos, run2_pos;
 	pl_idx_t curr_frame, fp, hp, tp, sp;
 	uint32_t curr_page;
 	uint8_t qnbr;
-	bool definite:1;
 	bool arg1_is_ground:1;
 	bool arg2_is_ground:1;
 	bool arg3_is_ground:1;
 };
 
+// The state only a few builtins use (clause/retract iteration,
+// probabilities and their own parameters). A choice only keeps a
+// copy, in a parallel array, when some of it isn't at its default...
+
+struct choice_aux_ {
+	db_entry *curr_clause2;
+	predicate *pr2;
+	miter *f_iter;
+	double prob;
+	pl_idx_t v1, v2;
+};
+
 struct choice_ {
 	prolog_state st;
 	uint64_t ugen;
-	pl_idx_t v1, v2, overflow;
+	pl_idx_t overflow;
 	uint32_t nbr_slots, nbr_vars, cgen, frame_cgen;
-	bool is_tail_rec:1;
-	bool catchme_retry:1;
-	bool catchme_exception:1;
-	bool barrier:1;
-	bool call_barrier:1;
-	bool soft_cut:1;
-	bool did_cleanup:1;
-	bool register_cleanup:1;
-	bool register_term:1;
-	bool block_catcher:1;
-	bool catcher:1;
+
+	union {
+		struct {
+			bool is_tail_rec:1;
+			bool catchme_retry:1;
+			bool catchme_exception:1;
+			bool barrier:1;
+			bool call_barrier:1;
+			bool soft_cut:1;
+			bool did_cleanup:1;
+			bool register_cleanup:1;
+			bool register_term:1;
+			bool block_catcher:1;
+			bool catcher:1;
+			bool has_aux:1;
+		};
+
+		uint16_t flags;
+	};
 };
 
 struct page_ {
@@ -536,6 +611,7 @@ struct page_ {
 	cell *heap;
 	pl_idx_t hp, max_hp_used, h_size;
 	unsigned nbr;
+	bool mark;
 };
 
 enum q_retry { QUERY_OK=0, QUERY_RETRY=1, QUERY_EXCEPTION=2 };
@@ -556,6 +632,7 @@ struct prolog_flags_ {
 
 struct query_ {
 	query *prev, *next, *parent;
+	query *live_prev, *live_next;
 	module *save_m, *current_m;
 	prolog *pl;
 	parser *p;
@@ -566,15 +643,19 @@ struct query_ {
 	cell *tmp_heap, *last_arg, *exception, *variable_names;
 	cell *queue[MAX_QUEUES], *tmpq[MAX_QUEUES];
 	bool ignores[MAX_IGNORES];
-	page *pages;
+	page *pages, *free_pages;
 	slot *save_e;
 	db_entry *dirty_list;
 	cycle_info *info1, *info2;
 	map *vars;
+	struct { cell *attrs; pl_idx_t ctx; unsigned var_nbr; } *tmp_attrs;
 	cell accum;
 	mpz_t tmp_ival;
 	prolog_state st;
-	uint64_t tot_goals, tot_backtracks, tot_retries, tot_matches, tot_tcos;
+	choice_aux aux;
+	choice_aux *choice_auxs;
+	uint64_t tot_goals, tot_backtracks, tot_retries, tot_matches, tot_tcos, tot_trims;
+	uint64_t tot_gcs, tot_gc_cells, gc_time, tot_pages_new, tot_pages_reused;
 	uint64_t step, qid;
 	uint64_t time_started, get_started;
 	uint64_t time_cpu_started, time_cpu_last_started;
@@ -583,8 +664,10 @@ struct query_ {
 	int nv_start;
 	pl_idx_t cp, tmphp, latest_ctx, popp, variable_names_ctx;
 	pl_idx_t frames_size, slots_size, trails_size, choices_size;
+	size_t frames_rsvd, slots_rsvd, trails_rsvd, choices_rsvd, choice_auxs_rsvd;
 	pl_idx_t max_choices, max_frames, max_slots, max_trails, before_hook_tp;
 	pl_idx_t h_size, tmph_size, tot_heaps, tot_heapsize, undo_lo_tp, undo_hi_tp;
+	pl_idx_t nbr_pages, nbr_free_pages, gc_pages, tmp_attrs_cnt, tmp_attrs_size, choice_auxs_size;
 	pl_idx_t q_size[MAX_QUEUES], tmpq_size[MAX_QUEUES], qp[MAX_QUEUES];
 	uint32_t cgen;
 	uint16_t mgen;
@@ -606,7 +689,6 @@ struct query_ {
 	bool is_dump_vars:1;
 	bool status:1;
 	bool resume:1;
-	bool no_tco:1;
 	bool check_unique:1;
 	bool has_vars:1;
 	bool error:1;
@@ -629,6 +711,7 @@ struct query_ {
 	bool listing:1;
 	bool in_commit:1;
 	bool did_quote:1;
+	bool gc_due:1;
 };
 
 struct parser_ {
@@ -639,6 +722,7 @@ struct parser_ {
 	} vartab;
 
 	prolog *pl;
+	parser *live_prev, *live_next;
 	FILE *fp;
 	module *m;
 	clause *cl;
@@ -695,7 +779,9 @@ struct module_ {
 	parser *p;
 	FILE *fp;
 	map *index, *nbs, *ops, *defops;
+	db_entry **refs;
 	struct loaded_file *loaded_files;
+	size_t refs_size, nbr_refs;
 	unsigned id, idx_used, indexing_threshold;
 	prolog_flags flags;
 	bool user_ops:1;
@@ -714,18 +800,46 @@ typedef struct {
 	bool is_anon;
 } var_item;
 
+// Atoms are interned in an open-addressing hash table of pool offsets,
+// each kept with its name's hash. In the pool every name is preceded
+// by an 'atom_hdr' giving its length in bytes and in characters.
+// Atoms no longer referenced are reclaimed by gc_atoms(), their space
+// going on free lists by size ('atoms_free') to be used again...
+
+typedef struct {
+	uint32_t hash;
+	pl_idx_t off;						// 0 for an empty slot
+} atom_slot;
+
+typedef struct {
+	uint32_t len, len_utf8, rank;
+} atom_hdr;
+
+#define ATOM_HDR(pl,off) ((const atom_hdr*)((pl)->pool + (off)) - 1)
+#define ATOM_LEN(pl,off) (ATOM_HDR(pl, off)->len)
+#define ATOM_LEN_UTF8(pl,off) (ATOM_HDR(pl, off)->len_utf8)
+#define ATOM_RANK(pl,off) (ATOM_HDR(pl, off)->rank)
+
+#define MAX_ATOM_CLASSES 64
+
 struct prolog_ {
 	stream streams[MAX_STREAMS];
 	module *modmap[MAX_MODULES];
 	module *modules;
 	module *system_m, *user_m, *curr_m, *dcgs;
-	parser *p;
+	parser *p, *parsers;
+	query *queries;
 	var_item *tabs;
 	struct { pl_idx_t tab1[MAX_IGNORES], tab2[MAX_IGNORES]; };
-	map *symtab, *funtab, *keyval;
+	map *funtab, *keyval;
+	atom_slot *atoms;
 	char *pool;
-	size_t pool_offset, pool_size, tabs_size;
-	uint64_t s_last, s_cnt, seed, ugen;
+	pl_idx_t atoms_free[MAX_ATOM_CLASSES];
+	db_slab *slabs_partial[MAX_SLAB_CLASSES], *slabs_full[MAX_SLAB_CLASSES];
+	size_t nbr_slabs, slab_free, dbe_live, dbe_large;
+	size_t pool_offset, pool_size, pool_free, pool_pinned, tabs_size;
+	size_t atoms_size, atoms_cnt, atoms_gc_at, rank_misses;
+	uint64_t s_last, s_cnt, seed, ugen, tot_atom_gcs, tot_atoms_freed;
 	unsigned next_mod_id;
 	uint8_t current_input, current_output, current_error;
 	int8_t halt_code, opt;
@@ -738,6 +852,7 @@ struct prolog_ {
 	bool noindex:1;
 	bool iso_only:1;
 	bool trace:1;
+	bool atoms_gc_due:1;
 };
 
 extern pl_idx_t g_empty_s, g_pair_s, g_dot_s, g_cut_s, g_nil_s, g_true_s, g_fail_s;
@@ -819,6 +934,29 @@ const char *dump_key(const void *k, const void *v, const void *p);
 
 #define slicecmp2(s1,l1,s2) slicecmp(s1,l1,s2,strlen(s2))
 
+// Atoms are ordered by their rank among all atoms sorted by name, as
+// given by rank_atoms(). One interned since then has no rank and is
+// compared by name, and once that has happened about as many times
+// as there are atoms they are all ranked again...
+
+void rank_atoms(prolog *pl);
+
+inline static int compare_atoms(prolog *pl, pl_idx_t off1, pl_idx_t off2)
+{
+	if (off1 == off2)
+		return 0;
+
+	uint32_t rank1 = ATOM_RANK(pl, off1), rank2 = ATOM_RANK(pl, off2);
+
+	if (rank1 && rank2)
+		return rank1 < rank2 ? -1 : 1;
+
+	if (++pl->rank_misses > pl->atoms_cnt)
+		rank_atoms(pl);
+
+	return slicecmp(pl->pool + off1, ATOM_LEN(pl, off1), pl->pool + off2, ATOM_LEN(pl, off2));
+}
+
 // A string builder...
 
 typedef struct {
@@ -19,6 +19,7 @@
 #define m_set sl_set
 #define m_app sl_app
 #define m_get sl_get
+#define m_get_by sl_get_by
 #define m_del sl_del
 #define m_count sl_count
 #define m_find sl_find
@@ -2,6 +2,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <ctype.h>
+#include <math.h>
 #include <sys/stat.h>
 
 #include "internal.h"
@@ -162,53 +163,933 @@ static void clear_loaded(const module *m)
 	}
 }
 
+// Below this many clauses a linear scan is just as quick...
+
+static const unsigned MIN_SWITCH_CLAUSES = 8;
+static const unsigned MAX_JIT_ARGS = 64;
+
+static bool get_switch_key(const cell *c, uint64_t *val, uint32_t *kind)
+{
+	if (is_literal(c)) {
+		*val = c->val_off;
+		*kind = ((uint32_t)c->arity << 8) | TAG_LITERAL;
+		return true;
+	}
+
+	if (is_smallint(c)) {
+		*val = (uint64_t)get_smallint(c);
+		*kind = TAG_INT;
+		return true;
+	}
+
+	// Reals unify by value, so -0.0 has to hash the same as 0.0,
+	// and a NaN never unifies with anything...
+
+	if (is_real(c) && !isnan(get_real(c))) {
+		double d = get_real(c) == 0.0 ? 0.0 : get_real(c);
+		memcpy(val, &d, sizeof(d));
+		*kind = TAG_REAL;
+		return true;
+	}
+
+	return false;
+}
+
+static pl_idx_t hash_switch_key(uint64_t val, uint32_t kind)
+{
+	uint64_t h = val ^ ((uint64_t)kind << 48);
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	return (pl_idx_t)h;
+}
+
+static db_key *find_switch_key(const db_switch *sw, uint64_t val, uint32_t kind)
+{
+	pl_idx_t mask = sw->size - 1;
+
+	for (pl_idx_t i = hash_switch_key(val, kind) & mask; ; i = (i + 1) & mask) {
+		db_key *k = sw->keys + i;
+
+		if (!k->kind || ((k->val == val) && (k->kind == kind)))
+			return k;
+	}
+}
+
+static void grow_switch(db_switch *sw)
+{
+	db_key *save = sw->keys;
+	pl_idx_t save_size = sw->size;
+	sw->size *= 2;
+	sw->keys = calloc(sw->size, sizeof(db_key));
+	ensure(sw->keys);
+
+	for (pl_idx_t i = 0; i < save_size; i++) {
+		if (save[i].kind)
+			*find_switch_key(sw, save[i].val, save[i].kind) = save[i];
+	}
+
+	free(save);
+}
+
+// Delete a key, shifting back any later keys in its probe sequence
+// so that no tombstones are needed...
+
+static void delete_switch_key(db_switch *sw, db_key *k)
+{
+	pl_idx_t mask = sw->size - 1;
+	pl_idx_t i = k - sw->keys;
+
+	for (pl_idx_t j = (i + 1) & mask; sw->keys[j].kind; j = (j + 1) & mask) {
+		pl_idx_t h = hash_switch_key(sw->keys[j].val, sw->keys[j].kind) & mask;
+
+		if (((j - h) & mask) >= ((j - i) & mask)) {
+			sw->keys[i] = sw->keys[j];
+			i = j;
+		}
+	}
+
+	sw->keys[i] = (db_key){0};
+	sw->nbr_keys--;
+}
+
+// Runs can grow at either end. A position is the logical number
+// of an entry, which stays the same when something is prepended,
+// so iterators in choice points aren't disturbed by an asserta...
+
+static void insert_into_run(db_run *run, db_entry *dbe, bool append)
+{
+	if (append && ((run->off + run->nbr) == run->size)) {
+		run->size = run->size ? run->size * 2 : 4;
+		run->dbes = realloc(run->dbes, sizeof(db_entry*) * run->size);
+		ensure(run->dbes);
+	} else if (!append && !run->off) {
+		pl_idx_t spare = run->nbr ? run->nbr : 4;
+		db_entry **dbes = malloc(sizeof(db_entry*) * (spare + run->size));
+		ensure(dbes);
+		memcpy(dbes + spare, run->dbes, sizeof(db_entry*) * run->nbr);
+		free(run->dbes);
+		run->dbes = dbes;
+		run->size += spare;
+		run->off = spare;
+	}
+
+	if (append) {
+		run->dbes[run->off + run->nbr++] = dbe;
+	} else {
+		run->dbes[--run->off] = dbe;
+		run->first--;
+		run->nbr++;
+	}
+}
+
+static bool remove_from_run(db_run *run, const db_entry *dbe)
+{
+	db_entry **dbes = run->dbes + run->off;
+	pl_idx_t lo = 0, hi = run->nbr;
+
+	while (lo < hi) {
+		pl_idx_t mid = lo + (hi - lo) / 2;
+
+		if ((int64_t)dbes[mid]->db_id < (int64_t)dbe->db_id)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if ((lo == run->nbr) || (dbes[lo] != dbe))
+		return false;
+
+	memmove(dbes + lo, dbes + lo + 1, sizeof(db_entry*) * (run->nbr - lo - 1));
+	run->nbr--;
+	return true;
+}
+
+static void destroy_switch(db_switch *sw)
+{
+	for (pl_idx_t i = 0; i < sw->size; i++) {
+		db_key *k = sw->keys + i;
+
+		if (!k->kind)
+			continue;
+
+		free(k->run->dbes);
+		free(k->run);
+
+		if (k->sub)
+			destroy_switch(k->sub);
+	}
+
+	m_destroy(sw->tree);
+	free(sw->vars.dbes);
+	free(sw->open.dbes);
+	free(sw->keys);
+	free(sw);
+}
+
+static cell *get_switch_arg(const db_switch *sw, db_entry *dbe)
+{
+	cell *c = get_head(dbe->cl.cells) + 1;
+
+	for (unsigned i = 0; i < sw->arg; i++)
+		c += c->nbr_cells;
+
+	// A clause in a sub switch without a compound here came from the
+	// parent's 'vars', so it has to stay in 'vars'...
+
+	if (sw->is_sub && c->arity)
+		c++;
+
+	return c;
+}
+
+// The ordered index maps a ground argument (which index_cmpkey
+// totally orders) to its own run. Strings are left out as they can
+// unify with lists, as are NaNs which don't compare...
+
+static bool is_tree_key(const cell *c)
+{
+	for (pl_idx_t nbr_cells = c->nbr_cells; nbr_cells--; c++) {
+		if (is_variable(c) || is_string(c) || is_indirect(c))
+			return false;
+
+		if (is_real(c) && isnan(get_real(c)))
+			return false;
+	}
+
+	return true;
+}
+
+static void tree_delkey(void *key, void *val, const void *p)
+{
+	db_run *run = val;
+	free(run->dbes);
+	free(run);
+}
+
+static void add_to_tree(db_switch *sw, db_entry *dbe, bool append)
+{
+	cell *c = get_switch_arg(sw, dbe);
+	db_run *run;
+
+	if (!is_tree_key(c)) {
+		insert_into_run(&sw->open, dbe, append);
+		return;
+	}
+
+	if (!m_get(sw->tree, c, (void*)&run)) {
+		run = calloc(1, sizeof(db_run));
+		ensure(run);
+		run->key = c;
+		m_set(sw->tree, c, run);
+	}
+
+	insert_into_run(run, dbe, append);
+}
+
+// The key of a run points into one of its clauses, so if that is
+// the one being removed the run has to be re-keyed...
+
+static void remove_from_tree(db_switch *sw, db_entry *dbe)
+{
+	cell *c = get_switch_arg(sw, dbe);
+	db_run *run;
+
+	if (!is_tree_key(c)) {
+		remove_from_run(&sw->open, dbe);
+		return;
+	}
+
+	if (!m_get(sw->tree, c, (void*)&run) || !remove_from_run(run, dbe))
+		return;
+
+	if (run->key != c)
+		return;
+
+	m_del(sw->tree, c);
+
+	if (!run->nbr) {
+		tree_delkey(NULL, run, NULL);
+		return;
+	}
+
+	run->key = get_switch_arg(sw, run->dbes[run->off]);
+	m_set(sw->tree, run->key, run);
+}
+
+static void build_tree(db_switch *sw, predicate *pr)
+{
+	sw->tree = m_create(index_cmpkey, tree_delkey, pr->m);
+	ensure(sw->tree);
+
+	for (db_entry *dbe = pr->head; dbe; dbe = dbe->next) {
+		if (!dbe->cl.ugen_erased)
+			add_to_tree(sw, dbe, true);
+	}
+}
+
+// A goal's argument can be looked up in the ordered index as it is,
+// dereferencing its variables as it goes, rather than first having
+// to make a ground copy of it...
+
+typedef struct {
+	query *q;
+	const module *m;
+	pl_idx_t ctx;
+} live_key;
+
+static bool is_live_tree_key(query *q, cell *c, pl_idx_t c_ctx, unsigned depth)
+{
+	if (depth > MAX_DEPTH)
+		return false;
+
+	c = deref(q, c, c_ctx);
+	c_ctx = q->latest_ctx;
+
+	if (is_variable(c) || is_string(c) || is_indirect(c))
+		return false;
+
+	if (is_real(c) && isnan(get_real(c)))
+		return false;
+
+	unsigned arity = c->arity;
+
+	for (c++; arity--; c += c->nbr_cells) {
+		if (!is_live_tree_key(q, c, c_ctx, depth+1))
+			return false;
+	}
+
+	return true;
+}
+
+static int cmp_live_key(const live_key *lk, const cell *p1, cell *p2, pl_idx_t p2_ctx)
+{
+	p2 = deref(lk->q, p2, p2_ctx);
+	p2_ctx = lk->q->latest_ctx;
+
+	if (!is_structure(p1) || !is_structure(p2))
+		return index_cmpkey(p1, p2, lk->m);
+
+	if (p1->arity != p2->arity)
+		return p1->arity < p2->arity ? -1 : 1;
+
+	if (p1->val_off != p2->val_off)
+		return strcmp(GET_STR(lk->m, p1), GET_STR(lk->m, p2));
+
+	unsigned arity = p1->arity;
+	p1++; p2++;
+
+	while (arity--) {
+		int i = cmp_live_key(lk, p1, p2, p2_ctx);
+
+		if (i != 0)
+			return i;
+
+		p1 += p1->nbr_cells;
+		p2 += p2->nbr_cells;
+	}
+
+	return 0;
+}
+
+static int live_cmpkey(const void *ptr1, const void *ptr2, const void *param)
+{
+	const live_key *lk = param;
+	return cmp_live_key(lk, ptr1, (cell*)ptr2, lk->ctx);
+}
+
+static void add_to_switch(db_switch *sw, db_entry *dbe, bool append)
+{
+	cell *c = get_switch_arg(sw, dbe);
+	uint64_t val;
+	uint32_t kind;
+
+	if (sw->tree)
+		add_to_tree(sw, dbe, append);
+
+	if (!get_switch_key(c, &val, &kind)) {
+		insert_into_run(&sw->vars, dbe, append);
+
+		for (pl_idx_t i = 0; sw->nbr_subs && (i < sw->size); i++) {
+			if (sw->keys[i].sub)
+				add_to_switch(sw->keys[i].sub, dbe, append);
+		}
+
+		return;
+	}
+
+	if (((sw->nbr_keys + 1) * 2) > sw->size)
+		grow_switch(sw);
+
+	db_key *k = find_switch_key(sw, val, kind);
+
+	if (!k->kind) {
+		k->val = val;
+		k->kind = kind;
+		k->run = calloc(1, sizeof(db_run));
+		ensure(k->run);
+		sw->nbr_keys++;
+	}
+
+	insert_into_run(k->run, dbe, append);
+
+	if (k->sub)
+		add_to_switch(k->sub, dbe, append);
+}
+
+static void remove_from_switch(db_switch *sw, db_entry *dbe)
+{
+	cell *c = get_switch_arg(sw, dbe);
+	uint64_t val;
+	uint32_t kind;
+
+	if (sw->tree)
+		remove_from_tree(sw, dbe);
+
+	if (!get_switch_key(c, &val, &kind)) {
+		remove_from_run(&sw->vars, dbe);
+
+		for (pl_idx_t i = 0; sw->nbr_subs && (i < sw->size); i++) {
+			if (sw->keys[i].sub)
+				remove_from_switch(sw->keys[i].sub, dbe);
+		}
+
+		return;
+	}
+
+	db_key *k = find_switch_key(sw, val, kind);
+
+	if (!k->kind || !remove_from_run(k->run, dbe))
+		return;
+
+	if (k->sub)
+		remove_from_switch(k->sub, dbe);
+
+	if (k->run->nbr)
+		return;
+
+	if (k->sub) {
+		destroy_switch(k->sub);
+		sw->nbr_subs--;
+	}
+
+	free(k->run->dbes);
+	free(k->run);
+	delete_switch_key(sw, k);
+}
+
+static void add_to_switches(predicate *pr, db_entry *dbe, bool append)
+{
+	if (pr->sw)
+		add_to_switch(pr->sw, dbe, append);
+
+	for (db_switch *sw = pr->jit; sw; sw = sw->next)
+		add_to_switch(sw, dbe, append);
+}
+
+// Only called when the predicate is no longer shared, so there can
+// be no iterators over the runs...
+
+void remove_from_switches(predicate *pr, db_entry *dbe)
+{
+	if (pr->sw)
+		remove_from_switch(pr->sw, dbe);
+
+	for (db_switch *sw = pr->jit; sw; sw = sw->next)
+		remove_from_switch(sw, dbe);
+}
+
+static db_switch *create_switch(predicate *pr, unsigned arg)
+{
+	db_switch *sw = calloc(1, sizeof(db_switch));
+	ensure(sw);
+	sw->arg = arg;
+	sw->size = 16;
+	sw->keys = calloc(sw->size, sizeof(db_key));
+	ensure(sw->keys);
+
+	for (db_entry *dbe = pr->head; dbe; dbe = dbe->next) {
+		if (!dbe->cl.ugen_erased)
+			add_to_switch(sw, dbe, true);
+	}
+
+	return sw;
+}
+
+// A sub switch holds the clauses of one compound key and those from
+// 'vars', keyed on the compound's first argument...
+
+static void build_sub_switch(db_switch *sw, db_key *k, predicate *pr)
+{
+	db_switch *sub = calloc(1, sizeof(db_switch));
+	ensure(sub);
+	sub->arg = sw->arg;
+	sub->is_sub = true;
+	sub->size = 16;
+	sub->keys = calloc(sub->size, sizeof(db_key));
+	ensure(sub->keys);
+
+	for (db_entry *dbe = pr->head; dbe; dbe = dbe->next) {
+		if (dbe->cl.ugen_erased)
+			continue;
+
+		uint64_t val;
+		uint32_t kind;
+
+		if (!get_switch_key(get_switch_arg(sw, dbe), &val, &kind)
+			|| ((val == k->val) && (kind == k->kind)))
+			add_to_switch(sub, dbe, true);
+	}
+
+	// Not worth keeping if it doesn't split the run...
+
+	if (sub->nbr_keys < 2) {
+		destroy_switch(sub);
+		k->no_sub = true;
+		return;
+	}
+
+	k->sub = sub;
+	sw->nbr_subs++;
+}
+
+// Declared indexes replace the automatic ones, and are kept even if
+// they don't (yet) discriminate...
+
+static void build_declared_switches(predicate *pr)
+{
+	for (unsigned i = pr->key.arity; i--;) {
+		if ((i >= MAX_JIT_ARGS) || !(pr->index_args & (1ULL << i)))
+			continue;
+
+		db_switch *sw = create_switch(pr, i);
+
+		if (!i) {
+			pr->sw = sw;
+			continue;
+		}
+
+		sw->next = pr->jit;
+		pr->jit = sw;
+	}
+}
+
+static void build_switch(predicate *pr)
+{
+	if (pr->index_args) {
+		build_declared_switches(pr);
+		return;
+	}
+
+	db_switch *sw = create_switch(pr, 0);
+
+	// A dynamic predicate keeps its switch even if it has no keys
+	// yet, rather than trying again on every assert...
+
+	if (!sw->nbr_keys && !pr->is_dynamic) {
+		destroy_switch(sw);
+		return;
+	}
+
+	pr->sw = sw;
+}
+
+// When a call can't select on the first argument but another one
+// is bound, a switch on that argument is built just in time. If it
+// turns out not to discriminate it is dropped, and not tried again
+// until the predicate has doubled in size...
+
+db_switch *get_jit_switch(predicate *pr, unsigned arg, const cell *c)
+{
+	for (db_switch *sw = pr->jit; sw; sw = sw->next) {
+		if (sw->arg == arg)
+			return sw;
+	}
+
+	if (pr->is_noindex || pr->index_args || (arg >= MAX_JIT_ARGS) || (pr->cnt < MIN_SWITCH_CLAUSES))
+		return NULL;
+
+	if (pr->jit_tried && (pr->cnt >= (pr->jit_cnt * 2)))
+		pr->jit_tried = 0;
+
+	uint64_t val;
+	uint32_t kind;
+
+	if ((pr->jit_tried & (1ULL << arg)) || !get_switch_key(c, &val, &kind))
+		return NULL;
+
+	pr->jit_tried |= 1ULL << arg;
+	pr->jit_cnt = pr->cnt;
+	db_switch *sw = create_switch(pr, arg);
+
+	// One key is enough if it's a compound, as then its run can be
+	// split up by the ordered index...
+
+	if (!sw->nbr_keys || ((sw->nbr_keys < 2) && !c->arity) || ((sw->vars.nbr * 2) > pr->cnt)) {
+		destroy_switch(sw);
+		return NULL;
+	}
+
+	sw->next = pr->jit;
+	pr->jit = sw;
+	return sw;
+}
+
+// Returns false if the goal's argument c (already dereferenced) can't
+// select clauses (it's a variable or unhashable), else the run (if
+// any) for its key and the run of clauses that could match any key.
+// A long run of one name/arity is narrowed down using the ordered
+// index, built on demand, when the argument is ground, else by a sub
+// switch on its first argument...
+
+bool search_switch(query *q, predicate *pr, db_switch *sw, cell *c, pl_idx_t c_ctx, const db_run **run, const db_run **others)
+{
+	uint64_t val;
+	uint32_t kind;
+
+	if (!get_switch_key(c, &val, &kind))
+		return false;
+
+	db_key *k = find_switch_key(sw, val, kind);
+	*run = k->kind ? k->run : NULL;
+	*others = &sw->vars;
+
+	if (!c->arity || !*run)
+		return true;
+
+	if (sw->tree || ((*run)->nbr >= pr->m->indexing_threshold)) {
+		if (is_live_tree_key(q, c, c_ctx, 0)) {
+			if (!sw->tree)
+				build_tree(sw, pr);
+
+			live_key lk = { .q = q, .m = pr->m, .ctx = c_ctx };
+			db_run *tree_run;
+			*run = m_get_by(sw->tree, c, live_cmpkey, &lk, (void*)&tree_run) ? tree_run : NULL;
+			*others = &sw->open;
+			return true;
+		}
+	}
+
+	if (k->sub || (!k->no_sub && ((*run)->nbr >= pr->m->indexing_threshold))) {
+		const cell *c1 = deref(q, c+1, c_ctx);
+
+		if (!get_switch_key(c1, &val, &kind))
+			return true;
+
+		if (!k->sub)
+			build_sub_switch(sw, k, pr);
+
+		if (!k->sub)
+			return true;
+
+		const db_key *k2 = find_switch_key(k->sub, val, kind);
+		*run = k2->kind ? k2->run : NULL;
+		*others = &k->sub->vars;
+	}
+
+	return true;
+}
+
+typedef struct {
+	const cell *hi;
+	const module *m;
+	void (*f)(const cell*, void*);
+	void *p;
+} range_scan;
+
+static int range_key(const void *key, const void *val, const void *p1)
+{
+	const range_scan *rs = p1;
+
+	if (index_cmpkey(key, rs->hi, rs->m) > 0)
+		return 0;
+
+	const db_run *run = val;
+
+	for (pl_idx_t i = 0; i < run->nbr; i++) {
+		if (!run->dbes[run->off+i]->cl.ugen_erased) {
+			rs->f(key, rs->p);
+			break;
+		}
+	}
+
+	return 1;
+}
+
+// Call f, in order, with each distinct (ground) value of argument
+// 'arg' from lo to hi. This is a seek and scan of the ordered index
+// of the argument's switch if there is one, else the values are
+// sorted here...
+
+void search_range(predicate *pr, unsigned arg, const cell *lo, const cell *hi, void (*f)(const cell*, void*), void *p)
+{
+	range_scan rs = { .hi = hi, .m = pr->m, .f = f, .p = p };
+	db_switch *sw = !arg ? pr->sw : NULL;
+
+	if (!sw)
+		sw = get_jit_switch(pr, arg, lo);
+
+	if (sw) {
+		if (!sw->tree)
+			build_tree(sw, pr);
+
+		sl_find(sw->tree, lo, range_key, &rs);
+		return;
+	}
+
+	map *vals = m_create(index_cmpkey, tree_delkey, pr->m);
+	ensure(vals);
+	db_switch tmp = { .arg = arg };
+
+	for (db_entry *dbe = pr->head; dbe; dbe = dbe->next) {
+		cell *c = get_switch_arg(&tmp, dbe);
+
+		if (dbe->cl.ugen_erased || !is_tree_key(c))
+			continue;
+
+		db_run *run;
+
+		if (!m_get(vals, c, (void*)&run)) {
+			run = calloc(1, sizeof(db_run));
+			ensure(run);
+			m_set(vals, c, run);
+		}
+
+		insert_into_run(run, dbe, true);
+	}
+
+	sl_find(vals, lo, range_key, &rs);
+	m_destroy(vals);
+}
+
+// Choice points may still be iterating over the runs of a switch
+// so it can only be freed once the predicate is no longer shared...
+
+static void stale_switch(predicate *pr, db_switch *sw)
+{
+	if (pr->ref_cnt) {
+		sw->next = pr->stale_sw;
+		pr->stale_sw = sw;
+		return;
+	}
+
+	destroy_switch(sw);
+}
+
+void retire_switch(predicate *pr)
+{
+	if (pr->sw)
+		stale_switch(pr, pr->sw);
+
+	while (pr->jit) {
+		db_switch *save = pr->jit->next;
+		stale_switch(pr, pr->jit);
+		pr->jit = save;
+	}
+
+	pr->sw = NULL;
+	pr->jit_tried = 0;
+}
+
+void purge_stale_switches(predicate *pr)
+{
+	while (pr->stale_sw) {
+		db_switch *save = pr->stale_sw->next;
+		destroy_switch(pr->stale_sw);
+		pr->stale_sw = save;
+	}
+}
+
 predicate *create_predicate(module *m, cell *c)
 {
-	bool found, function;
+	bool found, function;
+
+	if (strcmp(m->name, "format")) {
+		if (get_builtin(m->pl, GET_STR(m, c), c->arity, &found, &function), found && !function) {
+			fprintf(stdout, "Error: permission error modifying %s/%u\n", GET_STR(m, c), c->arity);
+			return NULL;
+		}
+	}
+
+	predicate *pr = calloc(1, sizeof(predicate));
+	ensure(pr);
+	pr->prev = m->tail;
+
+	if (m->tail)
+		m->tail->next = pr;
+
+	m->tail = pr;
+
+	if (!m->head)
+		m->head = pr;
+
+	pr->m = m;
+	pr->key = *c;
+	pr->key.tag = TAG_LITERAL;
+	pr->key.nbr_cells = 1;
+	pr->is_noindex = m->pl->noindex || !pr->key.arity;
+
+	//printf("*** create %s ==> %s/%u\n", m->filename, GET_STR(m, &pr->key), pr->key.arity);
+
+	if (GET_STR(m, c)[0] == '$')
+		pr->is_noindex = true;
+
+	m_app(m->index, &pr->key, pr);
+	return pr;
+}
+
+bool add_to_dirty_list(module *m, db_entry *dbe)
+{
+	if (!retract_from_db(m, dbe))
+		return false;
+
+	predicate *pr = dbe->owner;
+	dbe->dirty = pr->dirty_list;
+	pr->dirty_list = dbe;
+	return true;
+}
+
+static size_t slab_record_size(unsigned cls)
+{
+	return sizeof(db_slab*) + sizeof(db_entry) + (sizeof(cell) * SLAB_CLASS_CELLS * (cls+1));
+}
+
+static void link_slab(db_slab **list, db_slab *slab)
+{
+	slab->prev = NULL;
+	slab->next = *list;
+
+	if (*list)
+		(*list)->prev = slab;
+
+	*list = slab;
+}
+
+static void unlink_slab(db_slab **list, db_slab *slab)
+{
+	if (slab->prev)
+		slab->prev->next = slab->next;
+	else
+		*list = slab->next;
+
+	if (slab->next)
+		slab->next->prev = slab->prev;
+}
+
+static db_slab *create_slab(prolog *pl, unsigned cls)
+{
+	db_slab *slab = malloc(SLAB_SIZE);
+	if (!slab) return NULL;
+	size_t size = slab_record_size(cls);
+	slab->cls = cls;
+	slab->used = 0;
+	slab->nbr = (SLAB_SIZE - sizeof(db_slab)) / size;
+	slab->free = NULL;
+	char *obj = (char*)(slab+1) + (size * slab->nbr);
+
+	for (unsigned i = 0; i < slab->nbr; i++) {
+		obj -= size;
+		*(char**)obj = slab->free;
+		slab->free = obj;
+	}
+
+	link_slab(&pl->slabs_partial[cls], slab);
+	pl->slab_free += slab->nbr;
+	pl->nbr_slabs++;
+	return slab;
+}
+
+// Allocate a zeroed clause record with room for 'nbr_cells' cells
+// plus the end cell, whose contents are left to the caller...
+
+static db_entry *alloc_db_entry(prolog *pl, pl_idx_t nbr_cells)
+{
+	unsigned cls = (nbr_cells + SLAB_CLASS_CELLS) / SLAB_CLASS_CELLS - 1;
+
+	if (cls >= MAX_SLAB_CLASSES) {
+		db_slab **hdr = calloc(1, sizeof(db_slab*)+sizeof(db_entry)+(sizeof(cell)*(nbr_cells+1)));
+		if (!hdr) return NULL;
+		pl->dbe_large++;
+		pl->dbe_live++;
+		return (db_entry*)(hdr+1);
+	}
+
+	db_slab *slab = pl->slabs_partial[cls];
+
+	if (!slab && !(slab = create_slab(pl, cls)))
+		return NULL;
+
+	char *obj = slab->free;
+	slab->free = *(char**)obj;
+	slab->used++;
+	pl->slab_free--;
+	pl->dbe_live++;
+
+	if (!slab->free) {
+		unlink_slab(&pl->slabs_partial[cls], slab);
+		link_slab(&pl->slabs_full[cls], slab);
+	}
+
+	*(db_slab**)obj = slab;
+	db_entry *dbe = (db_entry*)(obj + sizeof(db_slab*));
+	memset(dbe, 0, sizeof(db_entry));
+	return dbe;
+}
+
+void free_db_entry(prolog *pl, db_entry *dbe)
+{
+	db_slab **hdr = (db_slab**)dbe - 1;
+	db_slab *slab = *hdr;
+	pl->dbe_live--;
 
-	if (strcmp(m->name, "format")) {
-		if (get_builtin(m->pl, GET_STR(m, c), c->arity, &found, &function), found && !function) {
-			fprintf(stdout, "Error: permission error modifying %s/%u\n", GET_STR(m, c), c->arity);
-			return NULL;
-		}
+	if (!slab) {
+		pl->dbe_large--;
+		free(hdr);
+		return;
 	}
 
-	predicate *pr = calloc(1, sizeof(predicate));
-	ensure(pr);
-	pr->prev = m->tail;
-
-	if (m->tail)
-		m->tail->next = pr;
+	unsigned cls = slab->cls;
 
-	m->tail = pr;
+	if (!slab->free) {
+		unlink_slab(&pl->slabs_full[cls], slab);
+		link_slab(&pl->slabs_partial[cls], slab);
+	}
 
-	if (!m->head)
-		m->head = pr;
+	*(char**)hdr = slab->free;
+	slab->free = (char*)hdr;
+	pl->slab_free++;
 
-	pr->m = m;
-	pr->key = *c;
-	pr->key.tag = TAG_LITERAL;
-	pr->key.nbr_cells = 1;
-	pr->is_noindex = m->pl->noindex || !pr->key.arity;
+	if (--slab->used)
+		return;
 
-	//printf("*** create %s ==> %s/%u\n", m->filename, GET_STR(m, &pr->key), pr->key.arity);
+	// Keep one empty slab per class so as not to thrash...
 
-	if (GET_STR(m, c)[0] == '$')
-		pr->is_noindex = true;
+	if ((pl->slabs_partial[cls] == slab) && !slab->next)
+		return;
 
-	m_app(m->index, &pr->key, pr);
-	return pr;
+	unlink_slab(&pl->slabs_partial[cls], slab);
+	pl->slab_free -= slab->nbr;
+	pl->nbr_slabs--;
+	free(slab);
 }
 
-bool add_to_dirty_list(module *m, db_entry *dbe)
+void destroy_slabs(prolog *pl)
 {
-	if (!retract_from_db(m, dbe))
-		return false;
+	for (unsigned i = 0; i < MAX_SLAB_CLASSES; i++) {
+		while (pl->slabs_partial[i]) {
+			db_slab *slab = pl->slabs_partial[i];
+			pl->slabs_partial[i] = slab->next;
+			free(slab);
+		}
 
-	predicate *pr = dbe->owner;
-	dbe->dirty = pr->dirty_list;
-	pr->dirty_list = dbe;
-	return true;
+		while (pl->slabs_full[i]) {
+			db_slab *slab = pl->slabs_full[i];
+			pl->slabs_full[i] = slab->next;
+			free(slab);
+		}
+	}
+
+	pl->nbr_slabs = pl->slab_free = 0;
 }
 
 static void destroy_predicate(module *m, predicate *pr)
@@ -220,7 +1101,7 @@ static void destroy_predicate(module *m, predicate *pr)
 
 		if (!dbe->cl.ugen_erased) {
 			clear_rule(&dbe->cl);
-			free(dbe);
+			free_db_entry(m->pl, dbe);
 		}
 
 		dbe = save;
@@ -229,12 +1110,12 @@ static void destroy_predicate(module *m, predicate *pr)
 	for (db_entry *dbe = pr->dirty_list; dbe;) {
 		db_entry *save = dbe->dirty;
 		clear_rule(&dbe->cl);
-		free(dbe);
+		free_db_entry(m->pl, dbe);
 		dbe = save;
 	}
 
-	m_destroy(pr->idx_save);
-	m_destroy(pr->idx);
+	retire_switch(pr);
+	purge_stale_switches(pr);
 	free(pr);
 }
 
@@ -250,10 +1131,7 @@ static int predicate_cmpkey(const void *ptr1, const void *ptr2, const void *para
 	if (p1->arity > p2->arity)
 		return 1;
 
-	if (p1->val_off == p2->val_off)
-		return 0;
-
-	return strcmp(m->pl->pool+p1->val_off, m->pl->pool+p2->val_off);
+	return compare_atoms(m->pl, p1->val_off, p2->val_off);
 }
 
 int index_cmpkey_(const void *ptr1, const void *ptr2, const void *param, int depth)
@@ -262,6 +1140,14 @@ int index_cmpkey_(const void *ptr1, const void *ptr2, const void *param, int dep
 	const cell *p2 = (const cell*)ptr2;
 	const module *m = (const module*)param;
 
+	// A string can unify with a list...
+
+	if ((is_string(p1) && is_iso_list(p2)) || (is_iso_list(p1) && is_string(p2)))
+		return 0;
+
+	// Numbers are ordered by value (so a range of them can be scanned)
+	// with a real before an integer of the same value...
+
 	if (is_smallint(p1)) {
 		if (is_bigint(p2)) {
 			return -mp_int_compare_value(&p2->val_bigint->ival, p1->val_int);
@@ -272,6 +1158,8 @@ int index_cmpkey_(const void *ptr1, const void *ptr2, const void *param, int dep
 				return 1;
 			else
 				return 0;
+		} else if (is_real(p2)) {
+			return (double)get_smallint(p1) < get_real(p2) ? -1 : 1;
 		} else if (!is_variable(p2))
 			return -1;
 	} else if (is_bigint(p1)) {
@@ -279,6 +1167,10 @@ int index_cmpkey_(const void *ptr1, const void *ptr2, const void *param, int dep
 			return mp_int_compare(&p1->val_bigint->ival, &p2->val_bigint->ival);
 		} else if (is_smallint(p2)) {
 			return mp_int_compare_value(&p1->val_bigint->ival, p2->val_int);
+		} else if (is_real(p2)) {
+			double d;
+			mp_int_to_double(&p1->val_bigint->ival, &d);
+			return d < get_real(p2) ? -1 : 1;
 		} else if (!is_variable(p2))
 			return -1;
 	} else if (is_real(p1)) {
@@ -289,17 +1181,18 @@ int index_cmpkey_(const void *ptr1, const void *ptr2, const void *param, int dep
 				return 1;
 			else
 				return 0;
-		} else if (is_integer(p2))
-			return 1;
-		else if (!is_variable(p2))
+		} else if (is_smallint(p2)) {
+			return get_real(p1) <= (double)get_smallint(p2) ? -1 : 1;
+		} else if (is_bigint(p2)) {
+			double d;
+			mp_int_to_double(&p2->val_bigint->ival, &d);
+			return get_real(p1) <= d ? -1 : 1;
+		} else if (!is_variable(p2))
 			return -1;
 	} else if (is_literal(p1) && !p1->arity) {
-		if (is_literal(p2) && !p2->arity) {
-			if (p1->val_off == p2->val_off)
-				return 0;
-
-			return strcmp(GET_STR(m, p1), GET_STR(m, p2));
-		} else if (is_atom(p2))
+		if (is_literal(p2) && !p2->arity)
+			return compare_atoms(m->pl, p1->val_off, p2->val_off);
+		else if (is_atom(p2))
 			return strcmp(GET_STR(m, p1), GET_STR(m, p2));
 		else if (is_number(p2))
 			return 1;
@@ -321,7 +1214,7 @@ int index_cmpkey_(const void *ptr1, const void *ptr2, const void *param, int dep
 				return 1;
 
 			if (p1->val_off != p2->val_off)
-				return strcmp(GET_STR(m, p1), GET_STR(m, p2));
+				return compare_atoms(m->pl, p1->val_off, p2->val_off);
 
 			int arity = p1->arity;
 			p1++; p2++;
@@ -349,18 +1242,105 @@ int index_cmpkey(const void *ptr1, const void *ptr2, const void *param)
 	return index_cmpkey_(ptr1, ptr2, param, 0);
 }
 
-db_entry *find_in_db(module *m, uuid *ref)
+// Clause references are found through a hash on their uuid. Entries
+// are added once the uuid is set and stay until the clause is finally
+// unlinked, so erased clauses have to be skipped...
+
+static size_t hash_uuid(const uuid *u)
 {
-	for (predicate *pr = m->head; pr; pr = pr->next) {
-		for (db_entry *dbe = pr->head ; dbe; dbe = dbe->next) {
-			if (dbe->cl.ugen_erased)
-				continue;
+	uint64_t h = u->u1 ^ (u->u2 * 0x9e3779b97f4a7c15ULL);
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	return (size_t)h;
+}
+
+static void grow_refs(module *m)
+{
+	db_entry **save = m->refs;
+	size_t save_size = m->refs_size;
+	m->refs_size = save_size ? save_size * 2 : 64;
+	m->refs = calloc(m->refs_size, sizeof(db_entry*));
+	ensure(m->refs);
+	size_t mask = m->refs_size - 1;
+
+	for (size_t i = 0; i < save_size; i++) {
+		if (!save[i])
+			continue;
+
+		size_t j = hash_uuid(&save[i]->u) & mask;
+
+		while (m->refs[j])
+			j = (j + 1) & mask;
 
-			if (!memcmp(&dbe->u, ref, sizeof(uuid)))
-				return dbe;
+		m->refs[j] = save[i];
+	}
+
+	free(save);
+}
+
+void add_to_refs(module *m, db_entry *dbe)
+{
+	if (!dbe->u.u1 && !dbe->u.u2)
+		return;
+
+	if (((m->nbr_refs + 1) * 2) > m->refs_size)
+		grow_refs(m);
+
+	size_t mask = m->refs_size - 1;
+	size_t i = hash_uuid(&dbe->u) & mask;
+
+	while (m->refs[i])
+		i = (i + 1) & mask;
+
+	m->refs[i] = dbe;
+	m->nbr_refs++;
+}
+
+void remove_from_refs(module *m, const db_entry *dbe)
+{
+	if (!m->refs)
+		return;
+
+	size_t mask = m->refs_size - 1;
+	size_t i = hash_uuid(&dbe->u) & mask;
+
+	while (m->refs[i] && (m->refs[i] != dbe))
+		i = (i + 1) & mask;
+
+	if (!m->refs[i])
+		return;
+
+	for (size_t j = (i + 1) & mask; m->refs[j]; j = (j + 1) & mask) {
+		size_t h = hash_uuid(&m->refs[j]->u) & mask;
+
+		if (((j - h) & mask) >= ((j - i) & mask)) {
+			m->refs[i] = m->refs[j];
+			i = j;
 		}
 	}
 
+	m->refs[i] = NULL;
+	m->nbr_refs--;
+}
+
+db_entry *find_in_db(module *m, uuid *ref)
+{
+	if (!m->refs)
+		return NULL;
+
+	size_t mask = m->refs_size - 1;
+
+	for (size_t i = hash_uuid(ref) & mask; m->refs[i]; i = (i + 1) & mask) {
+		db_entry *dbe = m->refs[i];
+
+		if (dbe->cl.ugen_erased)
+			continue;
+
+		if (!memcmp(&dbe->u, ref, sizeof(uuid)))
+			return dbe;
+	}
+
 	return NULL;
 }
 
@@ -380,7 +1360,7 @@ db_entry *erase_from_db(module *m, uuid *ref)
 {
 	db_entry *dbe = find_in_db(m, ref);
 	if (!dbe) return 0;
-	dbe->cl.ugen_erased = ++m->pl->ugen;
+	add_to_dirty_list(m, dbe);
 	return dbe;
 }
 
@@ -461,6 +1441,50 @@ void set_meta_predicate_in_db(module *m, cell *c)
 		m->error = true;
 }
 
+// The arguments of c are 1 for those positions to be indexed, else
+// 0. Any indexes already built are replaced...
+
+void set_index_in_db(module *m, cell *c)
+{
+	const char *name = GET_STR(m, c);
+	unsigned arity = c->arity;
+	cell tmp = (cell){0};
+	tmp.tag = TAG_LITERAL;
+	tmp.val_off = index_from_pool(m->pl, name);
+	ensure(tmp.val_off != ERR_IDX);
+	tmp.arity = arity;
+	predicate *pr = find_predicate(m, &tmp);
+	if (!pr) pr = create_predicate(m, &tmp);
+
+	if (!pr) {
+		m->error = true;
+		return;
+	}
+
+	uint64_t index_args = 0;
+	cell *arg = c + 1;
+
+	for (unsigned i = 0; i < arity; i++, arg += arg->nbr_cells) {
+		if ((i < MAX_JIT_ARGS) && is_smallint(arg) && get_smallint(arg))
+			index_args |= 1ULL << i;
+	}
+
+	query q = (query){0};
+	q.pl = m->pl;
+	q.st.m = m;
+	char *dst = print_canonical_to_strbuf(&q, c, 0, 0);
+	char tmpbuf[1024];
+	snprintf(tmpbuf, sizeof(tmpbuf), "index(%s)", dst);
+	push_property(m, name, arity, tmpbuf);
+	free(dst);
+	retire_switch(pr);
+	pr->index_args = index_args;
+	pr->is_noindex = !index_args;
+
+	if (pr->cnt && index_args)
+		build_switch(pr);
+}
+
 void set_persist_in_db(module *m, const char *name, unsigned arity)
 {
 	cell tmp = (cell){0};
@@ -812,74 +1836,160 @@ unsigned search_op(module *m, const char *name, unsigned *specifier, bool hint_p
 	return 0;
 }
 
-static void check_rule(module *m, db_entry *dbe)
+// A clause (or one of its first three arguments) is unique if no later
+// clause matches it. Checking each clause against all those after it
+// is quadratic, which hurts when loading a large file of facts, so the
+// clauses are visited last to first, each argument being looked up
+// among those already seen. A variable matches anything, and ground
+// keys are found in a map ordered by index_cmpkey, with only the rest
+// compared one by one. As a string compares equal to any list, keys
+// holding strings go in a map of their own, which can only be searched
+// with a key holding no lists (and vice versa)...
+//
+// This is only done for static predicates, once loaded. Clauses added
+// later by assert could make a dynamic clause no longer unique.
+
+typedef struct {
+	map *exact, *strings;
+	cell **wild;
+	size_t nbr_wild, size_wild;
+	bool seen, seen_var, seen_list;
+} seen_args;
+
+static bool is_seen_key(const cell *c, bool *has_str, bool *has_list)
 {
-	predicate *pr = dbe->owner;
-	clause *r = &dbe->cl;
-	bool matched = false, me = false;
-	bool p1_matched = false, p2_matched = false, p3_matched = false;
-	cell *head = get_head(r->cells);
-	cell *p1 = head + 1, *p2 = NULL, *p3 = NULL;
+	*has_str = *has_list = false;
+
+	for (pl_idx_t nbr_cells = c->nbr_cells; nbr_cells--; c++) {
+		if (is_variable(c) || is_indirect(c))
+			return false;
 
-	if (pr->key.arity > 1)
-		p2 = p1 + p1->nbr_cells;
+		if (is_real(c) && isnan(get_real(c)))
+			return false;
 
-	if (pr->key.arity > 2)
-		p3 = p2 + p2->nbr_cells;
+		if (is_string(c))
+			*has_str = true;
+		else if (is_iso_list(c))
+			*has_list = true;
+	}
 
-	for (db_entry *dbe = pr->head; dbe; dbe = dbe->next) {
-		if (dbe->cl.ugen_erased)
-			continue;
+	return !*has_str || !*has_list;
+}
 
-		if (!me) {
-			if (&dbe->cl == r)
-				me = true;
+static bool scan_seen(map *keys, cell *c, module *m)
+{
+	miter *iter = m_first(keys);
+	cell *c2;
 
-			continue;
+	while (m_next(iter, (void*)&c2)) {
+		if (!index_cmpkey(c, c2, m)) {
+			m_done(iter);
+			return true;
 		}
+	}
 
-		cell *head2 = get_head(dbe->cl.cells);
-		cell *h21 = head2 + 1, *h22 = NULL, *h23 = NULL;
-
-		if (pr->key.arity > 1)
-			h22 = h21 + h21->nbr_cells;
+	return false;
+}
 
-		if (pr->key.arity > 2)
-			h23 = h22 + h22->nbr_cells;
+static bool match_seen(seen_args *sa, cell *c, module *m)
+{
+	bool has_str, has_list;
+	bool is_key = is_seen_key(c, &has_str, &has_list);
+	bool matched = false;
+
+	if (!sa->seen)
+		;
+	else if (sa->seen_var || is_variable(c))
+		matched = true;
+	else {
+		if (is_key && (!has_str || !sa->seen_list))
+			matched = m_get(sa->exact, c, NULL);
+		else
+			matched = scan_seen(sa->exact, c, m);
 
-		if (!index_cmpkey(p1, h21, m))
-			p1_matched = true;
+		if (!matched && is_key && !has_list)
+			matched = m_get(sa->strings, c, NULL);
+		else if (!matched)
+			matched = scan_seen(sa->strings, c, m);
 
-		if (pr->key.arity > 1) {
-			if (!index_cmpkey(p2, h22, m))
-				p2_matched = true;
+		for (size_t i = 0; !matched && (i < sa->nbr_wild); i++) {
+			if (!index_cmpkey(c, sa->wild[i], m))
+				matched = true;
 		}
+	}
 
-		if (pr->key.arity > 2) {
-			if (!index_cmpkey(p3, h23, m))
-				p3_matched = true;
-		}
+	sa->seen = true;
 
-		if (!index_cmpkey(head, head2, m)) {
-			matched = true;
-			//break;
+	if (is_variable(c)) {
+		sa->seen_var = true;
+	} else if (is_key && !has_str) {
+		if (!m_get(sa->exact, c, NULL))
+			m_set(sa->exact, c, c);
+
+		if (has_list)
+			sa->seen_list = true;
+	} else if (is_key) {
+		if (!m_get(sa->strings, c, NULL))
+			m_set(sa->strings, c, c);
+	} else {
+		if (sa->nbr_wild == sa->size_wild) {
+			sa->size_wild = sa->size_wild ? sa->size_wild * 2 : 16;
+			sa->wild = realloc(sa->wild, sizeof(cell*) * sa->size_wild);
+			ensure(sa->wild);
 		}
-	}
 
-	if (!matched) {
-		r->is_unique = true;
+		sa->wild[sa->nbr_wild++] = c;
 	}
 
-	if (!p1_matched /*&& r->is_unique*/) {
-		r->arg1_is_unique = true;
+	return matched;
+}
+
+static void check_rules(module *m, predicate *pr)
+{
+	seen_args sa[4] = {0};
+	unsigned nbr_args = pr->key.arity < 3 ? pr->key.arity : 3;
+
+	for (unsigned i = 0; i <= nbr_args; i++) {
+		sa[i].exact = m_create(index_cmpkey, NULL, m);
+		ensure(sa[i].exact);
+		m_allow_dups(sa[i].exact, false);
+		sa[i].strings = m_create(index_cmpkey, NULL, m);
+		ensure(sa[i].strings);
+		m_allow_dups(sa[i].strings, false);
 	}
 
-	if (!p2_matched /*&& r->is_unique*/) {
-		r->arg2_is_unique = true;
+	for (db_entry *dbe = pr->tail; dbe; dbe = dbe->prev) {
+		if (dbe->cl.ugen_erased)
+			continue;
+
+		clause *r = &dbe->cl;
+		cell *head = get_head(r->cells);
+		cell *c = head + 1;
+		bool unique = false;
+
+		for (unsigned i = 0; i < nbr_args; i++, c += c->nbr_cells) {
+			if (!match_seen(&sa[i], c, m)) {
+				if (i == 0) r->arg1_is_unique = true;
+				else if (i == 1) r->arg2_is_unique = true;
+				else r->arg3_is_unique = true;
+				unique = true;
+			}
+		}
+
+		if (nbr_args < 2)
+			r->arg2_is_unique = true;
+
+		if (nbr_args < 3)
+			r->arg3_is_unique = true;
+
+		if (!match_seen(&sa[nbr_args], head, m) || unique)
+			r->is_unique = true;
 	}
 
-	if (!p3_matched /*&& r->is_unique*/) {
-		r->arg3_is_unique = true;
+	for (unsigned i = 0; i <= nbr_args; i++) {
+		m_destroy(sa[i].exact);
+		m_destroy(sa[i].strings);
+		free(sa[i].wild);
 	}
 }
 
@@ -929,13 +2039,15 @@ static db_entry *assert_begin(module *m, unsigned nbr_vars, unsigned nbr_tempora
 		}
 	}
 
-	if (!pr->is_dynamic)
+	if (!pr->is_dynamic) {
 		pr->is_processed = false;
+		retire_switch(pr);
+	}
 
 	if (m->prebuilt)
 		pr->is_prebuilt = true;
 
-	db_entry *dbe = calloc(sizeof(db_entry)+(sizeof(cell)*(p1->nbr_cells+1)), 1);
+	db_entry *dbe = alloc_db_entry(m->pl, p1->nbr_cells);
 	if (!dbe) {
 		pr->is_abolished = true;
 		return NULL;
@@ -962,29 +2074,12 @@ static void assert_commit(module *m, db_entry *dbe, predicate *pr, bool append)
 	pr->db_id++;
 	pr->cnt++;
 
-	if (pr->is_noindex || (pr->cnt < m->indexing_threshold))
-		return;
-
-	if (!pr->idx) {
-		//printf("*** index %s/%u\n", GET_STR(m, &pr->key), pr->key.arity);
-		pr->idx = m_create(index_cmpkey, NULL, m);
-		ensure(pr->idx);
-		m_allow_dups(pr->idx, true);
-
-		for (db_entry *cl2 = pr->head; cl2; cl2 = cl2->next) {
-			cell *c = get_head(cl2->cl.cells);
-
-			if (!cl2->cl.ugen_erased)
-				m_app(pr->idx, c, cl2);
-		}
+	if (pr->is_dynamic && !pr->is_noindex) {
+		if (!pr->sw && !pr->jit && (pr->index_args || (pr->cnt >= MIN_SWITCH_CLAUSES)))
+			build_switch(pr);
+		else
+			add_to_switches(pr, dbe, append);
 	}
-
-	cell *c = get_head(dbe->cl.cells);
-
-	if (!append)
-		m_set(pr->idx, c, dbe);
-	else
-		m_app(pr->idx, c, dbe);
 }
 
 static bool check_multifile(module *m, predicate *pr, db_entry *dbe)
@@ -1000,9 +2095,6 @@ static bool check_multifile(module *m, predicate *pr, db_entry *dbe)
 			if (dbe->owner->cnt)
 				fprintf(stderr, "Warning: overwriting %s/%u\n", GET_STR(m, &pr->key), pr->key.arity);
 
-			m_destroy(pr->idx_save);
-			m_destroy(pr->idx);
-			pr->idx_save = pr->idx = NULL;
 			pr->head = pr->tail = NULL;
 			dbe->owner->cnt = 0;
 			return false;
@@ -1017,15 +2109,20 @@ db_entry *asserta_to_db(module *m, unsigned nbr_vars, unsigned nbr_temporaries,
 	db_entry *dbe;
 	predicate *pr;
 
-	do {
+	for (;;) {
 		dbe = assert_begin(m, nbr_vars, nbr_temporaries, p1, consulting);
 		if (!dbe) return NULL;
 		pr = dbe->owner;
 
-		if (pr->head)
-			pr->head->prev = dbe;
+		if (check_multifile(m, pr, dbe))
+			break;
+
+		clear_rule(&dbe->cl);
+		free_db_entry(m->pl, dbe);
 	}
-	 while (!check_multifile(m, pr, dbe));
+
+	if (pr->head)
+		pr->head->prev = dbe;
 
 	dbe->next = pr->head;
 	pr->head = dbe;
@@ -1034,10 +2131,6 @@ db_entry *asserta_to_db(module *m, unsigned nbr_vars, unsigned nbr_temporaries,
 		pr->tail = dbe;
 
 	assert_commit(m, dbe, pr, false);
-
-	if (!consulting && (pr->cnt > 1))
-		check_rule(m, dbe);
-
 	return dbe;
 }
 
@@ -1046,15 +2139,20 @@ db_entry *assertz_to_db(module *m, unsigned nbr_vars, unsigned nbr_temporaries,
 	db_entry *dbe;
 	predicate *pr;
 
-	do {
+	for (;;) {
 		dbe = assert_begin(m, nbr_vars, nbr_temporaries, p1, consulting);
 		if (!dbe) return NULL;
 		pr = dbe->owner;
 
-		if (pr->tail)
-			pr->tail->next = dbe;
+		if (check_multifile(m, pr, dbe))
+			break;
+
+		clear_rule(&dbe->cl);
+		free_db_entry(m->pl, dbe);
 	}
-	 while (!check_multifile(m, pr, dbe));
+
+	if (pr->tail)
+		pr->tail->next = dbe;
 
 	dbe->prev = pr->tail;
 	pr->tail = dbe;
@@ -1109,6 +2207,106 @@ static void xref_cell(module *m, clause *r, cell *c, predicate *parent)
 	}
 }
 
+// Type tests and comparisons can't bind anything or leave a choice,
+// so an if-then-else with only these as its condition can be run
+// without a barrier...
+
+static const struct { const char *name; unsigned arity; } g_simple_tests[] = {
+	{"true", 0}, {"var", 1}, {"nonvar", 1}, {"atom", 1}, {"number", 1},
+	{"integer", 1}, {"float", 1}, {"atomic", 1}, {"compound", 1},
+	{"callable", 1}, {"is_list", 1}, {"string", 1}, {"ground", 1},
+	{"==", 2}, {"\\==", 2}, {"@<", 2}, {"@>", 2}, {"@=<", 2}, {"@>=", 2},
+	{"=:=", 2}, {"=\\=", 2}, {"<", 2}, {">", 2}, {"=<", 2}, {">=", 2},
+	{0}
+};
+
+static bool is_simple_test(module *m, const cell *c)
+{
+	if (!is_literal(c))
+		return false;
+
+	if ((c->val_off == g_conjunction_s) && (c->arity == 2)) {
+		const cell *c1 = c + 1;
+		const cell *c2 = c1 + c1->nbr_cells;
+		return is_simple_test(m, c1) && is_simple_test(m, c2);
+	}
+
+	if (!is_builtin(c) || !c->fn)
+		return false;
+
+	const char *functor = GET_STR(m, c);
+
+	for (unsigned i = 0; g_simple_tests[i].name; i++) {
+		if ((c->arity == g_simple_tests[i].arity) && !strcmp(functor, g_simple_tests[i].name))
+			return true;
+	}
+
+	return false;
+}
+
+// Arithmetic made up of just these, over integers and variables, is
+// worked out by is/2 and the comparisons straight off the cells...
+
+static const struct { const char *name; unsigned arity; } g_int_exprs[] = {
+	{"+", 2}, {"-", 2}, {"*", 2}, {"//", 2}, {"rem", 2}, {"-", 1},
+	{0}
+};
+
+static const char *g_int_evals[] = {
+	"is", "=:=", "=\\=", "<", ">", "=<", ">=",
+	NULL
+};
+
+static bool is_int_expr(module *m, const cell *c)
+{
+	if (is_variable(c) || is_smallint(c))
+		return true;
+
+	if (!is_literal(c) || !is_function(c) || !c->fn)
+		return false;
+
+	const char *functor = GET_STR(m, c);
+	unsigned i;
+
+	for (i = 0; g_int_exprs[i].name; i++) {
+		if ((c->arity == g_int_exprs[i].arity) && !strcmp(functor, g_int_exprs[i].name))
+			break;
+	}
+
+	if (!g_int_exprs[i].name)
+		return false;
+
+	const cell *c1 = c + 1;
+
+	if (!is_int_expr(m, c1))
+		return false;
+
+	return (c->arity == 1) || is_int_expr(m, c1 + c1->nbr_cells);
+}
+
+static void mark_int_expr(module *m, cell *c)
+{
+	if (c->arity && is_int_expr(m, c))
+		c->flags |= FLAG_INT_EXPR;
+	else
+		c->flags &= ~FLAG_INT_EXPR;
+}
+
+static bool is_int_eval(module *m, const cell *c)
+{
+	if ((c->arity != 2) || !is_builtin(c) || !c->fn)
+		return false;
+
+	const char *functor = GET_STR(m, c);
+
+	for (unsigned i = 0; g_int_evals[i]; i++) {
+		if (!strcmp(functor, g_int_evals[i]))
+			return true;
+	}
+
+	return false;
+}
+
 void xref_rule(module *m, clause *r, predicate *parent)
 {
 	r->arg1_is_unique = false;
@@ -1159,6 +2357,31 @@ void xref_rule(module *m, clause *r, predicate *parent)
 
 		xref_cell(m, r, c, parent);
 	}
+
+	for (pl_idx_t i = 0; i < r->cidx; i++) {
+		cell *c = r->cells + i;
+
+		if (!is_literal(c) || !is_builtin(c))
+			continue;
+
+		if (is_int_eval(m, c)) {
+			cell *c1 = c + 1;
+
+			if (strcmp(GET_STR(m, c), "is"))
+				mark_int_expr(m, c1);
+
+			mark_int_expr(m, c1 + c1->nbr_cells);
+			continue;
+		}
+
+		if (c->fn != fn_iso_if_then_2)
+			continue;
+
+		if (is_simple_test(m, c+1))
+			c[1].flags |= FLAG_SIMPLE_TEST;
+		else
+			c[1].flags &= ~FLAG_SIMPLE_TEST;
+	}
 }
 
 void xref_db(module *m)
@@ -1172,11 +2395,17 @@ void xref_db(module *m)
 		for (db_entry *dbe = pr->head; dbe; dbe = dbe->next)
 			xref_rule(m, &dbe->cl, pr);
 
-		if (pr->is_dynamic || pr->idx)
+		if (!pr->is_dynamic && !pr->is_noindex) {
+			retire_switch(pr);
+
+			if (pr->index_args || (pr->cnt >= MIN_SWITCH_CLAUSES))
+				build_switch(pr);
+		}
+
+		if (pr->is_dynamic)
 			continue;
 
-		for (db_entry *dbe = pr->head; dbe; dbe = dbe->next)
-			check_rule(m, dbe);
+		check_rules(m, pr);
 	}
 }
 
@@ -1243,9 +2472,7 @@ static bool unload_realfile(module *m, const char *filename)
 			}
 		}
 
-		m_destroy(pr->idx_save);
-		m_destroy(pr->idx);
-		pr->idx_save = pr->idx = NULL;
+		retire_switch(pr);
 
 		if (!pr->cnt) {
 			if (!pr->is_multifile && !pr->is_dynamic)
@@ -1552,6 +2779,8 @@ void destroy_module(module *m)
 		pr = save;
 	}
 
+	free(m->refs);
+
 	if (m->pl->modules == m) {
 		m->pl->modules = m->next;
 	} else {
@@ -1593,7 +2822,7 @@ module *create_module(prolog *pl, const char *name)
 	m->id = ++pl->next_mod_id;
 	m->defops = m_create((void*)strcmp, NULL, NULL);
 	m_allow_dups(m->defops, false);
-	m->indexing_threshold = 1000000;
+	m->indexing_threshold = 16;
 	pl->modmap[m->id] = m;
 
 	if (strcmp(name, "system")) {
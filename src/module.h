@@ -25,15 +25,26 @@ int index_cmpkey_(const void *ptr1, const void *ptr2, const void *param, int dep
 bool unload_file(module *m, const char *filename);
 void xref_rule(module *m, clause *t, predicate *parent);
 void xref_db(module *m);
+bool search_switch(query *q, predicate *pr, db_switch *sw, cell *c, pl_idx_t c_ctx, const db_run **run, const db_run **others);
+db_switch *get_jit_switch(predicate *pr, unsigned arg, const cell *c);
+void search_range(predicate *pr, unsigned arg, const cell *lo, const cell *hi, void (*f)(const cell*, void*), void *p);
+void remove_from_switches(predicate *pr, db_entry *dbe);
+void retire_switch(predicate *pr);
+void purge_stale_switches(predicate *pr);
 
 db_entry *asserta_to_db(module *m, unsigned nbr_vars, unsigned nbr_temporaries, cell *p1, bool consulting);
 db_entry *assertz_to_db(module *m, unsigned nbr_vars, unsigned nbr_temporaries, cell *p1, bool consulting);
 bool retract_from_db(module *m, db_entry *dbe);
+void free_db_entry(prolog *pl, db_entry *dbe);
+void destroy_slabs(prolog *pl);
 db_entry *find_in_db(module *m, uuid *ref);
+void add_to_refs(module *m, db_entry *dbe);
+void remove_from_refs(module *m, const db_entry *dbe);
 db_entry *erase_from_db(module *m, uuid *ref);
 
 void set_discontiguous_in_db(module *m, const char *name, unsigned arity);
 void set_dynamic_in_db(module *m, const char *name, unsigned arity);
 void set_meta_predicate_in_db(module *m, cell *c);
+void set_index_in_db(module *m, cell *c);
 void set_persist_in_db(module *m, const char *name, unsigned arity);
 void set_multifile_in_db(module *m, const char *name, pl_idx_t arity);
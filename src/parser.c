@@ -196,6 +196,14 @@ static cell *make_a_cell(parser *p)
 
 void destroy_parser(parser *p)
 {
+	if (p->live_prev)
+		p->live_prev->live_next = p->live_next;
+	else if (p->pl->parsers == p)
+		p->pl->parsers = p->live_next;
+
+	if (p->live_next)
+		p->live_next->live_prev = p->live_prev;
+
 	free(p->tmpbuf);
 	free(p->save_line);
 	free(p->token);
@@ -219,6 +227,12 @@ parser *create_parser(module *m)
 	p->start_term = true;
 	p->flags = m->flags;
 	p->line_nbr = 1;
+	p->live_next = p->pl->parsers;
+
+	if (p->live_next)
+		p->live_next->live_prev = p;
+
+	p->pl->parsers = p;
 	return p;
 }
 
@@ -388,6 +402,26 @@ static void directives(parser *p, cell *d)
 
 	cell *p1 = c + 1;
 
+	if (!strcmp(dirname, "index") && (c->arity == 1)) {
+		while (is_structure(p1) && !strcmp(GET_STR(p, p1), ",") && (p1->arity == 2)) {
+			if (!is_structure(p1+1)) break;
+			set_index_in_db(p->m, p1+1);
+			p1 += 1;
+			p1 += p1->nbr_cells;
+		}
+
+		if (!is_structure(p1)) {
+			if (DUMP_ERRS || !p->do_read_term)
+				fprintf(stdout, "Error: index expects a callable term, line %u\n", p->line_nbr);
+
+			p->error = true;
+			return;
+		}
+
+		set_index_in_db(p->m, p1);
+		return;
+	}
+
 	if (!strcmp(dirname, "include") && (c->arity == 1)) {
 		if (!is_atom(p1)) return;
 		unsigned save_line_nbr = p->line_nbr;
@@ -83,18 +83,21 @@ pl_status do_yield_0(query *q, int msecs)
 	return pl_failure;
 }
 
-static void set_params(query *q, pl_idx_t p1, pl_idx_t p2)
+static bool set_params(query *q, pl_idx_t p1, pl_idx_t p2)
 {
-	choice *ch = GET_CURR_CHOICE();
-	ch->v1 = p1;
-	ch->v2 = p2;
+	choice_aux *a = get_choice_aux(q, GET_CURR_CHOICE());
+	if (!a) return false;
+	a->v1 = p1;
+	a->v2 = p2;
+	return true;
 }
 
 static void get_params(query *q, pl_idx_t *p1, pl_idx_t *p2)
 {
-	choice *ch = GET_CURR_CHOICE();
-	if (p1) *p1 = ch->v1;
-	if (p2) *p2 = ch->v2;
+	const choice *ch = GET_CURR_CHOICE();
+	const choice_aux *a = ch->has_aux ? q->choice_auxs + (ch - q->choices) : NULL;
+	if (p1) *p1 = a ? a->v1 : 0;
+	if (p2) *p2 = a ? a->v2 : 0;
 }
 
 void make_ref(cell *tmp, pl_idx_t ctx, pl_idx_t off, unsigned var_nbr)
@@ -1331,7 +1334,9 @@ static USE_RESULT pl_status fn_iso_sub_atom_5(query *q)
 	for (size_t i = before; i <= len_p1; i++) {
 		for (size_t j = len; j <= (len_p1-i); j++) {
 			CHECK_INTERRUPT();
-			set_params(q, i, j+1);
+			if (!set_params(q, i, j+1))
+				return pl_error;
+
 			may_error(push_choice(q));
 			cell tmp;
 			make_int(&tmp, i);
@@ -1993,6 +1998,7 @@ static USE_RESULT pl_status fn_iso_copy_term_2(query *q)
 			may_heap_error(tmp);
 			e2->c.attrs = tmp;
 			e2->c.attrs_ctx = q->st.curr_frame;
+			pin_frame(q, q->st.curr_frame, p2_ctx);
 		}
 
 		return pl_success;
@@ -2053,7 +2059,7 @@ static USE_RESULT pl_status fn_iso_clause_2(query *q)
 
 	while (match_clause(q, p1, p1_ctx, DO_CLAUSE) == pl_success) {
 		if (q->did_throw) return pl_success;
-		clause *r = &q->st.curr_clause2->cl;
+		clause *r = &q->aux.curr_clause2->cl;
 		cell *body = get_body(r->cells);
 		pl_status ok;
 
@@ -2066,7 +2072,7 @@ static USE_RESULT pl_status fn_iso_clause_2(query *q)
 		}
 
 		if (ok) {
-			db_entry *dbe = q->st.curr_clause2;
+			db_entry *dbe = q->aux.curr_clause2;
 			bool last_match = !dbe->next || !more_data(dbe->owner);
 			stash_me(q, r, last_match);
 			return pl_success;
@@ -2100,7 +2106,7 @@ pl_status do_retract(query *q, cell *p1, pl_idx_t p1_ctx, enum clause_type is_re
 	if ((match != pl_success) || q->did_throw)
 		return match;
 
-	db_entry *dbe = q->st.curr_clause2;
+	db_entry *dbe = q->aux.curr_clause2;
 	bool last_match = (!dbe->next || !more_data(dbe->owner)) && (is_retract == DO_RETRACT);
 	stash_me(q, &dbe->cl, last_match);
 
@@ -2163,16 +2169,10 @@ static pl_status do_abolish(query *q, cell *c_orig, cell *c, bool hard)
 		add_to_dirty_list(q->st.m, dbe);
 	}
 
-	m_destroy(pr->idx);
-	pr->idx = NULL;
+	retire_switch(pr);
 
-	if (hard) {
+	if (hard)
 		pr->is_abolished = true;
-	} else {
-		pr->idx = m_create(index_cmpkey, NULL, q->st.m);
-		ensure(pr->idx);
-		m_allow_dups(pr->idx, false);
-	}
 
 	pr->head = pr->tail = NULL;
 	pr->cnt = 0;
@@ -2331,6 +2331,7 @@ static USE_RESULT pl_status fn_iso_asserta_1(query *q)
 
 	p->cl->cidx = 0;
 	uuid_gen(q->pl, &dbe->u);
+	add_to_refs(dbe->owner->m, dbe);
 
 	if (!q->st.m->loading && dbe->owner->is_persist)
 		db_log(q, dbe, LOG_ASSERTA);
@@ -2394,6 +2395,7 @@ static USE_RESULT pl_status fn_iso_assertz_1(query *q)
 
 	p->cl->cidx = 0;
 	uuid_gen(q->pl, &dbe->u);
+	add_to_refs(dbe->owner->m, dbe);
 
 	if (!q->st.m->loading && dbe->owner->is_persist)
 		db_log(q, dbe, LOG_ASSERTZ);
@@ -2536,12 +2538,12 @@ static USE_RESULT pl_status fn_iso_current_rule_1(query *q)
 static bool search_functor(query *q, cell *p1, pl_idx_t p1_ctx, cell *p2, pl_idx_t p2_ctx)
 {
 	if (!q->retry)
-		q->st.f_iter = m_first(q->st.m->index);
+		q->aux.f_iter = m_first(q->st.m->index);
 
 	DISCARD_RESULT push_choice(q);
 	predicate *pr = NULL;
 
-	while (m_next(q->st.f_iter, (void*)&pr)) {
+	while (m_next(q->aux.f_iter, (void*)&pr)) {
 		CHECK_INTERRUPT();
 
 		if (pr->is_abolished)
@@ -2556,12 +2558,14 @@ static bool search_functor(query *q, cell *p1, pl_idx_t p1_ctx, cell *p2, pl_idx
 
 		if (unify(q, p1, p1_ctx, &tmpn, q->st.fp)
 			&& unify(q, p2, p2_ctx, &tmpa, q->st.fp)) {
+			q->aux.f_iter = NULL;		// the choice has it now
 			return true;
 		}
 
 		undo_me(q);
 	}
 
+	q->aux.f_iter = NULL;
 	drop_choice(q);
 	return false;
 }
@@ -2951,7 +2955,9 @@ static int nodecmp(const void *ptr1, const void *ptr2)
 		p2_ctx = q->latest_ctx;
 	}
 
-	int ok = compare(q, p1, p1_ctx, p2, p2_ctx);
+	int ok = is_literal(p1) && !p1->arity && is_literal(p2) && !p2->arity ?
+		compare_atoms(q->pl, p1->val_off, p2->val_off) :
+		compare(q, p1, p1_ctx, p2, p2_ctx);
 
 	if (ascending)
 		return ok < 0 ? -1 : ok > 0 ? 1 : 0;
@@ -3552,7 +3558,7 @@ static USE_RESULT pl_status fn_clause_3(query *q)
 			if (!dbe || (!u.u1 && !u.u2))
 				break;
 
-			q->st.curr_clause2 = dbe;
+			q->aux.curr_clause2 = dbe;
 			r = &dbe->cl;
 			cell *head = get_head(r->cells);
 
@@ -3563,12 +3569,12 @@ static USE_RESULT pl_status fn_clause_3(query *q)
 				break;
 
 			char tmpbuf[128];
-			uuid_to_buf(&q->st.curr_clause2->u, tmpbuf, sizeof(tmpbuf));
+			uuid_to_buf(&q->aux.curr_clause2->u, tmpbuf, sizeof(tmpbuf));
 			cell tmp;
 			may_error(make_cstring(&tmp, tmpbuf));
 			set_var(q, p3, p3_ctx, &tmp, q->st.curr_frame);
 			unshare_cell(&tmp);
-			r = &q->st.curr_clause2->cl;
+			r = &q->aux.curr_clause2->cl;
 		}
 
 		cell *body = get_body(r->cells);
@@ -3584,10 +3590,11 @@ static USE_RESULT pl_status fn_clause_3(query *q)
 
 		if (ok) {
 			if (is_variable(p3)) {
-				db_entry *dbe = q->st.curr_clause2;
+				db_entry *dbe = q->aux.curr_clause2;
 				bool last_match = !dbe->next || !more_data(dbe->owner);
 				stash_me(q, r, last_match);
-			}
+			} else
+				q->aux.curr_clause2 = NULL;
 
 			return pl_success;
 		}
@@ -3675,6 +3682,8 @@ static pl_status do_asserta_2(query *q)
 		unshare_cell(&tmp2);
 	}
 
+	add_to_refs(dbe->owner->m, dbe);
+
 	if (!q->st.m->loading && dbe->owner->is_persist)
 		db_log(q, dbe, LOG_ASSERTA);
 
@@ -3775,6 +3784,8 @@ static pl_status do_assertz_2(query *q)
 		unshare_cell(&tmp2);
 	}
 
+	add_to_refs(dbe->owner->m, dbe);
+
 	if (!q->st.m->loading && dbe->owner->is_persist)
 		db_log(q, dbe, LOG_ASSERTZ);
 
@@ -3946,10 +3957,10 @@ static USE_RESULT pl_status fn_sys_dump_keys_1(query *q)
 	if (!pr)
 		return pl_failure;
 
-	if (!pr->idx)
+	if (!pr->sw || !pr->sw->tree)
 		return pl_success;
 
-	fprintf(stderr, "\n"); sl_dump(pr->idx, dump_key, q);
+	fprintf(stderr, "\n"); sl_dump(pr->sw->tree, dump_key, q);
 	return pl_success;
 }
 
@@ -3988,10 +3999,17 @@ static USE_RESULT pl_status fn_time_1(query *q)
 static USE_RESULT pl_status fn_statistics_0(query *q)
 {
 	fprintf(stdout,
-		"Goals %llu, Matches %llu, Max frames %u, choices %u, trails %u, slots %u, heap: %u. Backtracks %llu, TCOs:%llu\n",
+		"Goals %llu, Matches %llu, Max frames %u, choices %u, trails %u, slots %u, heap: %u. Backtracks %llu, TCOs:%llu, Trims:%llu, GCs:%llu\n",
 		(unsigned long long)q->tot_goals, (unsigned long long)q->tot_matches,
 		q->max_frames, q->max_choices, q->max_trails, q->max_slots, q->st.hp,
-		(unsigned long long)q->tot_retries, (unsigned long long)q->tot_tcos);
+		(unsigned long long)q->tot_retries, (unsigned long long)q->tot_tcos,
+		(unsigned long long)q->tot_trims, (unsigned long long)q->tot_gcs);
+	return pl_success;
+}
+
+static USE_RESULT pl_status fn_garbage_collect_atoms_0(query *q)
+{
+	gc_atoms(q->pl);
 	return pl_success;
 }
 
@@ -4011,11 +4029,84 @@ static USE_RESULT pl_status fn_statistics_2(query *q)
 
 	if (!CMP_SLICE2(q, p1, "gctime") && is_variable(p2)) {
 		cell tmp;
-		make_real(&tmp, 0);
+		make_real(&tmp, (double)q->gc_time/1000/1000);
 		set_var(q, p2, p2_ctx, &tmp, q->st.curr_frame);
 		return pl_success;
 	}
 
+	if (!CMP_SLICE2(q, p1, "garbage_collection")) {
+		cell tmp;
+		make_int(&tmp, q->tot_gcs);
+		allocate_list(q, &tmp);
+		make_int(&tmp, q->tot_gc_cells * sizeof(cell));
+		append_list(q, &tmp);
+		make_int(&tmp, q->gc_time/1000);
+		append_list(q, &tmp);
+		cell *l = end_list(q);
+		may_ptr_error(l);
+		return unify(q, p2, p2_ctx, l, q->st.curr_frame);
+	}
+
+	if (!CMP_SLICE2(q, p1, "pages")) {
+		cell tmp;
+		make_int(&tmp, q->nbr_pages);
+		allocate_list(q, &tmp);
+		make_int(&tmp, q->nbr_free_pages);
+		append_list(q, &tmp);
+		make_int(&tmp, q->tot_pages_new);
+		append_list(q, &tmp);
+		make_int(&tmp, q->tot_pages_reused);
+		append_list(q, &tmp);
+		make_int(&tmp, q->h_size);
+		append_list(q, &tmp);
+		cell *l = end_list(q);
+		may_ptr_error(l);
+		return unify(q, p2, p2_ctx, l, q->st.curr_frame);
+	}
+
+	if (!CMP_SLICE2(q, p1, "atoms")) {
+		cell tmp;
+		make_int(&tmp, q->pl->atoms_cnt);
+		allocate_list(q, &tmp);
+		make_int(&tmp, q->pl->pool_offset - q->pl->pool_free);
+		append_list(q, &tmp);
+		make_int(&tmp, q->pl->tot_atom_gcs);
+		append_list(q, &tmp);
+		make_int(&tmp, q->pl->tot_atoms_freed);
+		append_list(q, &tmp);
+		cell *l = end_list(q);
+		may_ptr_error(l);
+		return unify(q, p2, p2_ctx, l, q->st.curr_frame);
+	}
+
+	if (!CMP_SLICE2(q, p1, "clauses")) {
+		cell tmp;
+		make_int(&tmp, q->pl->dbe_live);
+		allocate_list(q, &tmp);
+		make_int(&tmp, q->pl->dbe_large);
+		append_list(q, &tmp);
+		make_int(&tmp, q->pl->nbr_slabs);
+		append_list(q, &tmp);
+		make_int(&tmp, q->pl->slab_free);
+		append_list(q, &tmp);
+		cell *l = end_list(q);
+		may_ptr_error(l);
+		return unify(q, p2, p2_ctx, l, q->st.curr_frame);
+	}
+
+	if (!CMP_SLICE2(q, p1, "frames")) {
+		cell tmp;
+		make_int(&tmp, q->max_frames);
+		allocate_list(q, &tmp);
+		make_int(&tmp, q->tot_tcos);
+		append_list(q, &tmp);
+		make_int(&tmp, q->tot_trims);
+		append_list(q, &tmp);
+		cell *l = end_list(q);
+		may_ptr_error(l);
+		return unify(q, p2, p2_ctx, l, q->st.curr_frame);
+	}
+
 	if (!CMP_SLICE2(q, p1, "runtime")) {
 		uint64_t now = cpu_time_in_usec();
 		double elapsed = now - q->time_cpu_started;
@@ -4032,6 +4123,50 @@ static USE_RESULT pl_status fn_statistics_2(query *q)
 		return unify(q, p2, p2_ctx, l, q->st.curr_frame);
 	}
 
+	if (!CMP_SLICE2(q, p1, "indexes")) {
+		bool any = false;
+
+		for (predicate *pr = q->st.m->head; pr; pr = pr->next) {
+			for (unsigned i = 0; i < pr->key.arity; i++) {
+				db_switch *sw = !i ? pr->sw : NULL;
+
+				for (db_switch *jit = pr->jit; i && jit && !sw; jit = jit->next) {
+					if (jit->arg == i)
+						sw = jit;
+				}
+
+				if (!sw)
+					continue;
+
+				cell tmp[5];
+				make_struct(tmp+0, g_minus_s, NULL, 2, 4);
+				SET_OP(tmp+0, OP_YFX);
+				make_struct(tmp+1, g_slash_s, NULL, 2, 2);
+				SET_OP(tmp+1, OP_YFX);
+				make_atom(tmp+2, pr->key.val_off);
+				make_int(tmp+3, pr->key.arity);
+				make_int(tmp+4, i+1);
+
+				if (!any)
+					allocate_list(q, tmp);
+				else
+					append_list(q, tmp);
+
+				any = true;
+			}
+		}
+
+		if (!any) {
+			cell tmp;
+			make_atom(&tmp, g_nil_s);
+			return unify(q, p2, p2_ctx, &tmp, q->st.curr_frame);
+		}
+
+		cell *l = end_list(q);
+		may_ptr_error(l);
+		return unify(q, p2, p2_ctx, l, q->st.curr_frame);
+	}
+
 	return pl_failure;
 }
 
@@ -5449,6 +5584,54 @@ static USE_RESULT pl_status fn_sys_load_ops_0(query *q)
 	return pl_success;
 }
 
+typedef struct {
+	query *q;
+	bool any;
+} range_list;
+
+static void append_range_key(const cell *c, void *p)
+{
+	range_list *rl = p;
+
+	if (!rl->any)
+		allocate_list(rl->q, c);
+	else
+		append_list(rl->q, c);
+
+	rl->any = true;
+}
+
+// Lists the values of an argument in a range, for index_range/4...
+
+static USE_RESULT pl_status fn_sys_index_range_5(query *q)
+{
+	GET_FIRST_ARG(p1,callable);
+	GET_NEXT_ARG(p2,integer);
+	GET_NEXT_ARG(p3,atomic);
+	GET_NEXT_ARG(p4,atomic);
+	GET_NEXT_ARG(p5,list_or_var);
+	predicate *pr = find_predicate(q->st.m, p1);
+
+	if (!pr)
+		return throw_error(q, p1, p1_ctx, "existence_error", "procedure");
+
+	if ((get_int(p2) < 1) || (get_int(p2) > p1->arity))
+		return pl_failure;
+
+	range_list rl = { .q = q };
+	search_range(pr, get_int(p2)-1, p3, p4, append_range_key, &rl);
+
+	if (!rl.any) {
+		cell tmp;
+		make_atom(&tmp, g_nil_s);
+		return unify(q, p5, p5_ctx, &tmp, q->st.curr_frame);
+	}
+
+	cell *l = end_list(q);
+	may_ptr_error(l);
+	return unify(q, p5, p5_ctx, l, q->st.curr_frame);
+}
+
 static USE_RESULT pl_status fn_sys_legacy_predicate_property_2(query *q)
 {
 	GET_FIRST_ARG(p1,callable);
@@ -5927,6 +6110,7 @@ static USE_RESULT pl_status fn_sys_put_attributes_2(query *q)
 	slot *e = GET_SLOT(f, p1->var_nbr);
 	e->c.attrs = p2;
 	e->c.attrs_ctx = p2_ctx;
+	pin_frame(q, p2_ctx, p1_ctx);
 	return pl_success;
 }
 
@@ -6702,6 +6886,7 @@ static const struct builtins g_other_bifs[] =
 	{"unsetenv", 1, fn_unsetenv_1, NULL, false},
 	{"statistics", 0, fn_statistics_0, NULL, false},
 	{"statistics", 2, fn_statistics_2, "+string,-variable", false},
+	{"garbage_collect_atoms", 0, fn_garbage_collect_atoms_0, NULL, false},
 	{"duplicate_term", 2, fn_iso_copy_term_2, "+term,-variable", false},
 	{"call_nth", 2, fn_call_nth_2, "+callable,+integer", false},
 	{"limit", 2, fn_limit_2, "+integer,+callable", false},
@@ -6718,6 +6903,7 @@ static const struct builtins g_other_bifs[] =
 	{"$redo_trail", 0, fn_sys_redo_trail_0, NULL, false},
 	{"$between", 4, fn_between_3, "+integer,+integer,-integer", false},
 	{"$legacy_predicate_property", 2, fn_sys_legacy_predicate_property_2, "+callable,?string", false},
+	{"$index_range", 5, fn_sys_index_range_5, "+callable,+integer,+atomic,+atomic,?list", false},
 	{"$load_properties", 0, fn_sys_load_properties_0, NULL, false},
 	{"$load_flags", 0, fn_sys_load_flags_0, NULL, false},
 	{"$load_ops", 0, fn_sys_load_ops_0, NULL, false},
@@ -8,6 +8,7 @@
 #include "parser.h"
 #include "module.h"
 #include "prolog.h"
+#include "utf8.h"
 
 void convert_path(char *filename);
 
@@ -46,38 +47,305 @@ bool is_multifile_in_db(prolog *pl, const char *mod, const char *name, unsigned
 	return pr->is_multifile ? true : false;
 }
 
-static pl_idx_t add_to_pool(prolog *pl, const char *name)
+static const size_t INITIAL_NBR_ATOMS = 4096;	// power of 2
+
+static uint32_t hash_name(const char *name, size_t len)
+{
+	uint32_t h = 2166136261U;
+
+	while (len--) {
+		h ^= (uint8_t)*name++;
+		h *= 16777619U;
+	}
+
+	return h;
+}
+
+static void insert_atom(prolog *pl, uint32_t h, pl_idx_t off)
 {
-	size_t offset = pl->pool_offset, len = strlen(name);
-
-	while ((offset+len+1+1) >= pl->pool_size) {
-		size_t nbytes = (size_t)pl->pool_size * 3 / 2;
-		char *tmp = realloc(pl->pool, nbytes);
-		if (!tmp) return ERR_IDX;
-		pl->pool = tmp;
-		memset(pl->pool + pl->pool_size, 0, nbytes - pl->pool_size);
-		pl->pool_size = nbytes;
+	size_t mask = pl->atoms_size - 1;
+	size_t i = h & mask;
+
+	while (pl->atoms[i].off)
+		i = (i + 1) & mask;
+
+	pl->atoms[i].hash = h;
+	pl->atoms[i].off = off;
+}
+
+static bool grow_atoms(prolog *pl)
+{
+	atom_slot *save = pl->atoms;
+	size_t save_size = pl->atoms_size;
+	size_t nbr = save_size ? save_size * 2 : INITIAL_NBR_ATOMS;
+	pl->atoms = calloc(nbr, sizeof(atom_slot));
+
+	if (!pl->atoms) {
+		pl->atoms = save;
+		return false;
 	}
 
-	if ((offset + len + 1) >= UINT32_MAX)
-		return ERR_IDX;
+	pl->atoms_size = nbr;
+
+	for (size_t i = 0; i < save_size; i++) {
+		if (save[i].off)
+			insert_atom(pl, save[i].hash, save[i].off);
+	}
 
+	free(save);
+	return true;
+}
+
+// Names are laid out on a 4-byte boundary, after their header. Blocks
+// freed by gc_atoms() are kept on a list for their size, the header
+// of a free block holding its size and the next one on the list. The
+// few too big for a list of their own share the first, first fit...
+
+static size_t atom_block_size(size_t len)
+{
+	return (sizeof(atom_hdr) + len + 1 + 3) & ~(size_t)3;
+}
+
+static pl_idx_t reuse_block(prolog *pl, size_t nbytes)
+{
+	size_t cls = nbytes / 4;
+	pl_idx_t *ptr = &pl->atoms_free[cls < MAX_ATOM_CLASSES ? cls : 0];
+
+	while (*ptr) {
+		atom_hdr *hdr = (atom_hdr*)(pl->pool + *ptr) - 1;
+
+		if ((hdr->len >= nbytes) && (hdr->len <= (nbytes * 2))) {
+			pl_idx_t offset = *ptr;
+			*ptr = hdr->len_utf8;
+			pl->pool_free -= hdr->len;
+			return offset;
+		}
+
+		ptr = &hdr->len_utf8;
+	}
+
+	return 0;
+}
+
+static void free_block(prolog *pl, pl_idx_t offset)
+{
+	atom_hdr *hdr = (atom_hdr*)(pl->pool + offset) - 1;
+	size_t nbytes = atom_block_size(hdr->len);
+	size_t cls = nbytes / 4;
+	pl_idx_t *ptr = &pl->atoms_free[cls < MAX_ATOM_CLASSES ? cls : 0];
+	hdr->len = nbytes;
+	hdr->len_utf8 = *ptr;
+	*ptr = offset;
+	pl->pool_free += nbytes;
+}
+
+static pl_idx_t add_to_pool(prolog *pl, const char *name, size_t len, uint32_t h)
+{
+	if (((pl->atoms_cnt + 1) * 2) > pl->atoms_size) {
+		if (!grow_atoms(pl))
+			return ERR_IDX;
+	}
+
+	size_t nbytes = atom_block_size(len);
+	size_t offset = reuse_block(pl, nbytes);
+
+	if (!offset) {
+		size_t start = pl->pool_offset;
+
+		if ((start + nbytes) >= UINT32_MAX)
+			return ERR_IDX;
+
+		while ((start + nbytes) >= pl->pool_size) {
+			size_t size = (size_t)pl->pool_size * 3 / 2;
+			char *tmp = realloc(pl->pool, size);
+			if (!tmp) return ERR_IDX;
+			pl->pool = tmp;
+			memset(pl->pool + pl->pool_size, 0, size - pl->pool_size);
+			pl->pool_size = size;
+		}
+
+		pl->pool_offset = start + nbytes;
+		offset = start + sizeof(atom_hdr);
+	}
+
+	atom_hdr *hdr = (atom_hdr*)(pl->pool + offset) - 1;
+	hdr->len = len;
+	hdr->len_utf8 = substrlen_utf8(name, len);
+	hdr->rank = 0;
 	memcpy(pl->pool + offset, name, len+1);
-	pl->pool_offset += len + 1;
-	const char *key = strdup(name);
-	m_set(pl->symtab, key, (void*)(size_t)offset);
+	insert_atom(pl, h, offset);
 	g_literal_cnt++;
+
+	if (++pl->atoms_cnt == pl->atoms_gc_at)
+		pl->atoms_gc_due = true;
+
 	return (pl_idx_t)offset;
 }
 
 pl_idx_t index_from_pool(prolog *pl, const char *name)
 {
-	const void *val;
+	size_t len = strlen(name);
+	uint32_t h = hash_name(name, len);
+	size_t mask = pl->atoms_size - 1;
+
+	for (size_t i = h & mask; pl->atoms[i].off; i = (i + 1) & mask) {
+		const atom_slot *a = pl->atoms + i;
+
+		if ((a->hash == h) && (ATOM_LEN(pl, a->off) == len)
+			&& !memcmp(pl->pool + a->off, name, len))
+			return a->off;
+	}
+
+	return add_to_pool(pl, name, len, h);
+}
+
+typedef struct {
+	const char *name;
+	size_t len;
+	pl_idx_t off;
+} atom_name;
+
+static int atom_name_cmp(const void *ptr1, const void *ptr2)
+{
+	const atom_name *a1 = (const atom_name*)ptr1;
+	const atom_name *a2 = (const atom_name*)ptr2;
+	return slicecmp(a1->name, a1->len, a2->name, a2->len);
+}
+
+void rank_atoms(prolog *pl)
+{
+	pl->rank_misses = 0;
+	atom_name *names = malloc(sizeof(atom_name) * pl->atoms_cnt);
+	if (!names) return;
+	size_t nbr = 0;
+
+	for (size_t i = 0; (i < pl->atoms_size) && (nbr < pl->atoms_cnt); i++) {
+		pl_idx_t off = pl->atoms[i].off;
+
+		if (!off)
+			continue;
+
+		names[nbr].name = pl->pool + off;
+		names[nbr].len = ATOM_LEN(pl, off);
+		names[nbr].off = off;
+		nbr++;
+	}
+
+	qsort(names, nbr, sizeof(atom_name), atom_name_cmp);
+
+	for (size_t i = 0; i < nbr; i++) {
+		atom_hdr *hdr = (atom_hdr*)(pl->pool + names[i].off) - 1;
+		hdr->rank = i + 1;
+	}
 
-	if (m_get(pl->symtab, name, &val))
-		return (pl_idx_t)(size_t)val;
+	free(names);
+}
+
+// Atoms are collected by marking every one named by a cell in the
+// database, in a live query (its heap, slots and queues) or in a
+// parser's clause being built, and dropping the rest from the table.
+// Those interned before pl_create() returned are never collected as
+// the C code holds on to them. Offsets kept in C locals aren't seen,
+// so this is only safe between goals (see start) or when asked for by
+// garbage_collect_atoms/0. It runs by itself when the number of atoms
+// has doubled since the last time.
 
-	return add_to_pool(pl, name);
+static void mark_cells(prolog *pl, uint8_t *marks, const cell *c, size_t nbr_cells)
+{
+	for (; nbr_cells--; c++) {
+		if (((c->tag == TAG_LITERAL) || (c->tag == TAG_VAR))
+			&& (c->val_off < pl->pool_offset)) {
+			pl_idx_t n = c->val_off / 4;
+			marks[n / 8] |= 1 << (n % 8);
+		}
+	}
+}
+
+static void mark_clauses(prolog *pl, uint8_t *marks, const db_entry *dbe, bool dirty)
+{
+	while (dbe) {
+		mark_cells(pl, marks, dbe->cl.cells, dbe->cl.cidx);
+		dbe = dirty ? dbe->dirty : dbe->next;
+	}
+}
+
+static void mark_query(prolog *pl, uint8_t *marks, const query *q)
+{
+	for (const page *a = q->pages; a; a = a->next)
+		mark_cells(pl, marks, a->heap, a->max_hp_used);
+
+	for (pl_idx_t i = 0; i < q->slots_size; i++)
+		mark_cells(pl, marks, &q->slots[i].c, 1);
+
+	if (q->tmp_heap)
+		mark_cells(pl, marks, q->tmp_heap, q->tmphp);
+
+	for (int i = 0; i < MAX_QUEUES; i++) {
+		if (q->queue[i])
+			mark_cells(pl, marks, q->queue[i], q->qp[i]);
+
+		if (q->tmpq[i])
+			mark_cells(pl, marks, q->tmpq[i], q->tmpq_size[i]);
+	}
+
+	mark_cells(pl, marks, &q->accum, 1);
+	mark_clauses(pl, marks, q->dirty_list, true);
+}
+
+void gc_atoms(prolog *pl)
+{
+	pl->atoms_gc_due = false;
+	uint8_t *marks = calloc(pl->pool_offset / 4 / 8 + 1, 1);
+	atom_slot *atoms = calloc(pl->atoms_size, sizeof(atom_slot));
+
+	if (!marks || !atoms) {
+		free(marks);
+		free(atoms);
+		return;
+	}
+
+	for (const module *m = pl->modules; m; m = m->next) {
+		for (const predicate *pr = m->head; pr; pr = pr->next) {
+			mark_cells(pl, marks, &pr->key, 1);
+			mark_clauses(pl, marks, pr->head, false);
+			mark_clauses(pl, marks, pr->dirty_list, true);
+		}
+	}
+
+	for (const query *q = pl->queries; q; q = q->live_next)
+		mark_query(pl, marks, q);
+
+	for (const parser *p = pl->parsers; p; p = p->live_next) {
+		mark_cells(pl, marks, p->cl->cells, p->cl->cidx);
+		mark_cells(pl, marks, &p->v, 1);
+	}
+
+	atom_slot *save = pl->atoms;
+	pl->atoms = atoms;
+	pl->atoms_cnt = 0;
+
+	for (size_t i = 0; i < pl->atoms_size; i++) {
+		pl_idx_t off = save[i].off;
+
+		if (!off)
+			continue;
+
+		pl_idx_t n = off / 4;
+
+		if ((off < pl->pool_pinned) || (marks[n / 8] & (1 << (n % 8)))) {
+			insert_atom(pl, save[i].hash, off);
+			pl->atoms_cnt++;
+			continue;
+		}
+
+		free_block(pl, off);
+		pl->tot_atoms_freed++;
+	}
+
+	free(save);
+	free(marks);
+	pl->atoms_gc_at = pl->atoms_cnt * 2;
+	pl->tot_atom_gcs++;
 }
 
 module *find_next_module(prolog *pl, module *m)
@@ -169,9 +437,11 @@ void pl_destroy(prolog *pl)
 	while (pl->modules)
 		destroy_module(pl->modules);
 
+	destroy_slabs(pl);
+
 	m_destroy(pl->funtab);
-	m_destroy(pl->symtab);
 	m_destroy(pl->keyval);
+	free(pl->atoms);
 	free(pl->pool);
 	free(pl->tabs);
 	pl->pool_offset = 0;
@@ -230,12 +500,10 @@ prolog *pl_create()
 	if (!pl->pool) return NULL;
 	bool error = false;
 
-	CHECK_SENTINEL(pl->symtab = m_create((void*)strcmp, (void*)free, NULL), NULL);
 	CHECK_SENTINEL(pl->keyval = m_create((void*)strcmp, (void*)keyvalfree, NULL), NULL);
-	m_allow_dups(pl->symtab, false);
 	m_allow_dups(pl->keyval, false);
 
-	if (error) {
+	if (error || !grow_atoms(pl)) {
 		free(pl->pool);
 		return NULL;
 	}
@@ -398,5 +666,7 @@ prolog *pl_create()
 	}
 
 	pl->user_m->prebuilt = false;
+	pl->pool_pinned = pl->pool_offset;
+	pl->atoms_gc_at = pl->atoms_cnt * 2;
 	return pl;
 }
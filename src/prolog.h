@@ -4,6 +4,7 @@ void *get_builtin(prolog *pl, const char *name, unsigned arity, bool *found, boo
 module *find_module(prolog *pl, const char *name);
 module *find_next_module(prolog *pl, module *m);
 pl_idx_t index_from_pool(prolog *pl, const char *name);
+void gc_atoms(prolog *pl);
 bool is_multifile_in_db(prolog *pl, const char *mod, const char *name, unsigned arity);
 void load_builtins(prolog *pl);
 
@@ -35,6 +35,13 @@ static const unsigned INITIAL_NBR_SLOTS = 1000;
 static const unsigned INITIAL_NBR_CHOICES = 1000;
 static const unsigned INITIAL_NBR_TRAILS = 1000;
 
+// Address space reserved for each stack (a task gets a sixteenth)...
+
+static const size_t MAX_NBR_GOALS = 1UL<<26;
+static const size_t MAX_NBR_SLOTS = 1UL<<26;
+static const size_t MAX_NBR_CHOICES = 1UL<<24;
+static const size_t MAX_NBR_TRAILS = 1UL<<26;
+
 unsigned g_string_cnt = 0, g_literal_cnt = 0;
 int g_tpl_interrupt = 0;
 
@@ -106,58 +113,55 @@ static void trace_call(query *q, cell *c, pl_idx_t c_ctx, box_t box)
 
 static USE_RESULT pl_status check_trail(query *q)
 {
-	while (q->st.tp > q->max_trails) {
-		if (q->st.tp >= q->trails_size) {
-			pl_idx_t new_trailssize = alloc_grow((void**)&q->trails, sizeof(trail), q->st.tp, q->trails_size*4/3);
-			if (!new_trailssize) {
-				q->is_oom = q->error = true;
-				return pl_error;
-			}
-
-			q->trails_size = new_trailssize;
+	if (q->st.tp >= q->trails_size) {
+		pl_idx_t new_trailssize = stack_grow((void**)&q->trails, sizeof(trail), q->st.tp+1, q->trails_size*4/3, q->trails_rsvd);
+		if (!new_trailssize) {
+			q->is_oom = q->error = true;
+			return pl_error;
 		}
 
-		q->max_trails = q->st.tp;
+		q->trails_size = new_trailssize;
 	}
 
+	if (q->st.tp > q->max_trails)
+		q->max_trails = q->st.tp;
+
 	return pl_success;
 }
 
 static USE_RESULT pl_status check_choice(query *q)
 {
-	while (q->cp > q->max_choices) {
-		if (q->cp >= q->choices_size) {
-			pl_idx_t new_choicessize = alloc_grow((void**)&q->choices, sizeof(choice), q->cp, q->choices_size*4/3);
-			if (!new_choicessize) {
-				q->is_oom = q->error = true;
-				return pl_error;
-			}
-
-			q->choices_size = new_choicessize;
+	if (q->cp >= q->choices_size) {
+		pl_idx_t new_choicessize = stack_grow((void**)&q->choices, sizeof(choice), q->cp+1, q->choices_size*4/3, q->choices_rsvd);
+		if (!new_choicessize) {
+			q->is_oom = q->error = true;
+			return pl_error;
 		}
 
-		q->max_choices = q->cp;
+		q->choices_size = new_choicessize;
 	}
 
+	if (q->cp > q->max_choices)
+		q->max_choices = q->cp;
+
 	return pl_success;
 }
 
 static USE_RESULT pl_status check_frame(query *q)
 {
-	while (q->st.fp > q->max_frames) {
-		if (q->st.fp >= q->frames_size) {
-			pl_idx_t new_framessize = alloc_grow((void**)&q->frames, sizeof(frame), q->st.fp, q->frames_size*4/3);
-			if (!new_framessize) {
-				q->is_oom = q->error = true;
-				return pl_error;
-			}
-
-			q->frames_size = new_framessize;
+	if (q->st.fp >= q->frames_size) {
+		pl_idx_t new_framessize = stack_grow((void**)&q->frames, sizeof(frame), q->st.fp+1, q->frames_size*4/3, q->frames_rsvd);
+		if (!new_framessize) {
+			q->is_oom = q->error = true;
+			return pl_error;
 		}
 
-		q->max_frames = q->st.fp;
+		q->frames_size = new_framessize;
 	}
 
+	if (q->st.fp > q->max_frames)
+		q->max_frames = q->st.fp;
+
 	return pl_success;
 }
 
@@ -165,24 +169,49 @@ static USE_RESULT pl_status check_slot(query *q, unsigned cnt)
 {
 	pl_idx_t nbr = q->st.sp + cnt;
 
-	while (nbr > q->max_slots) {
-		if (nbr >= q->slots_size) {
-			pl_idx_t new_slotssize = alloc_grow((void**)&q->slots, sizeof(slot), nbr, (nbr*4/3));
-			if (!new_slotssize) {
-				q->is_oom = q->error = true;
-				return pl_error;
-			}
+	if (nbr >= q->slots_size) {
+		pl_idx_t new_slotssize = stack_grow((void**)&q->slots, sizeof(slot), nbr+1, nbr*4/3, q->slots_rsvd);
+		if (!new_slotssize) {
+			q->is_oom = q->error = true;
+			return pl_error;
+		}
+
+		// Fresh pages of a reserved stack are already zeroed...
 
+		if (!q->slots_rsvd)
 			memset(q->slots+q->slots_size, 0, sizeof(slot)*(new_slotssize-q->slots_size));
-			q->slots_size = new_slotssize;
-		}
 
-		q->max_slots = nbr;
+		q->slots_size = new_slotssize;
 	}
 
+	if (nbr > q->max_slots)
+		q->max_slots = nbr;
+
 	return pl_success;
 }
 
+// After a spike give most of a stack back to the OS...
+
+static pl_idx_t trim_stack(void *addr, size_t elem_size, pl_idx_t size, pl_idx_t used, unsigned initial, size_t reserved)
+{
+	if ((size <= (initial*4)) || (used >= (size/4)))
+		return size;
+
+	pl_idx_t keep = used * 2 > initial ? used * 2 : initial;
+	return stack_trim(addr, elem_size, size, keep, reserved);
+}
+
+static void trim_stacks(query *q)
+{
+	q->frames_size = trim_stack(q->frames, sizeof(frame), q->frames_size, q->st.fp, INITIAL_NBR_GOALS, q->frames_rsvd);
+	q->slots_size = trim_stack(q->slots, sizeof(slot), q->slots_size, q->st.sp, INITIAL_NBR_SLOTS, q->slots_rsvd);
+	q->choices_size = trim_stack(q->choices, sizeof(choice), q->choices_size, q->cp, INITIAL_NBR_CHOICES, q->choices_rsvd);
+
+	if (q->choice_auxs)
+		q->choice_auxs_size = trim_stack(q->choice_auxs, sizeof(choice_aux), q->choice_auxs_size, q->cp, INITIAL_NBR_CHOICES, q->choice_auxs_rsvd);
+	q->trails_size = trim_stack(q->trails, sizeof(trail), q->trails_size, q->st.tp, INITIAL_NBR_TRAILS, q->trails_rsvd);
+}
+
 bool more_data(const predicate *pr)
 {
 	return (pr->cnt > 1) || (pr->ref_cnt > 1);
@@ -199,26 +228,43 @@ static bool can_view(const frame *f, const db_entry *dbe)
 	return true;
 }
 
-static bool is_next_key(query *q, clause *r)
+static db_entry *run_entry(const db_run *run, pl_idx_t pos)
 {
-	const frame *f = GET_CURR_FRAME();
+	if (!run)
+		return NULL;
 
-	if (q->st.iter) {
-		db_entry *next;
+	pl_idx_t i = pos - run->first;
+	return i < run->nbr ? run->dbes[run->off + i] : NULL;
+}
 
-		while (m_is_next(q->st.iter, (void*)&next)) {
-			if (can_view(f, next))
-				return true;
+// Merge the key's run with the var run back into database order,
+// optionally consuming the next entry...
 
-			m_next(q->st.iter, (void*)&next);
-		}
+static db_entry *next_in_runs(query *q, bool consume)
+{
+	db_entry *dbe1 = run_entry(q->st.run1, q->st.run1_pos);
+	db_entry *dbe2 = run_entry(q->st.run2, q->st.run2_pos);
+
+	if (dbe1 && dbe2) {
+		if ((int64_t)dbe1->db_id < (int64_t)dbe2->db_id)
+			dbe2 = NULL;
+		else
+			dbe1 = NULL;
+	}
 
-		q->st.iter = NULL;
-		return false;
+	if (consume) {
+		if (dbe1)
+			q->st.run1_pos++;
+		else if (dbe2)
+			q->st.run2_pos++;
 	}
 
-	if (!q->st.curr_clause->next || q->st.definite)
-		return false;
+	return dbe1 ? dbe1 : dbe2;
+}
+
+static bool is_next_key(query *q, clause *r)
+{
+	const frame *f = GET_CURR_FRAME();
 
 	if (q->st.arg1_is_ground && r->arg1_is_unique)
 		return false;
@@ -229,6 +275,19 @@ static bool is_next_key(query *q, clause *r)
 	if (q->st.arg3_is_ground && r->arg3_is_unique)
 		return false;
 
+	if (q->st.run1 || q->st.run2) {
+		db_entry *next;
+
+		while ((next = next_in_runs(q, false)) != NULL) {
+			if (can_view(f, next))
+				return true;
+
+			next_in_runs(q, true);
+		}
+
+		return false;
+	}
+
 	db_entry *next = q->st.curr_clause->next;
 
 	while (next && !can_view(f, next))
@@ -239,30 +298,11 @@ static bool is_next_key(query *q, clause *r)
 
 static void next_key(query *q)
 {
-	if (q->st.iter) {
-		if (!m_next(q->st.iter, (void*)&q->st.curr_clause)) {
-			q->st.curr_clause = NULL;
-			q->st.iter = NULL;
-		}
-	} else if (!q->st.definite)
+	if (q->st.run1 || q->st.run2) {
+		if (!(q->st.curr_clause = next_in_runs(q, true)))
+			q->st.run1 = q->st.run2 = NULL;
+	} else
 		q->st.curr_clause = q->st.curr_clause->next;
-	else
-		q->st.curr_clause = NULL;
-}
-
-static bool is_all_vars(cell *c)
-{
-	unsigned arity = c->arity;
-	c++;
-
-	while (arity--) {
-		if (!is_variable(c))
-			return false;
-
-		c += c->nbr_cells;
-	}
-
-	return true;
 }
 
 static bool is_ground(cell *c)
@@ -277,100 +317,95 @@ static bool is_ground(cell *c)
 	return true;
 }
 
-static void find_key(query *q, predicate *pr, cell *key)
+static bool find_in_switch(query *q, predicate *pr, db_switch *sw, cell *key, unsigned arg)
 {
-	q->st.definite = false;
-	q->st.arg1_is_ground = false;
-	q->st.arg2_is_ground = false;
-	q->st.arg3_is_ground = false;
-	q->st.iter = NULL;
+	cell *c = key + 1;
 
-	if (!pr->idx
-#if 1
-		|| !pr->is_dynamic		// FIXME
-#endif
-		|| (pr->cnt < q->st.m->indexing_threshold)) {
-		q->st.curr_clause = pr->head;
+	for (unsigned i = 0; i < arg; i++)
+		c += c->nbr_cells;
 
-		if (!key->arity || pr->is_multifile || pr->is_dynamic)
-			return;
+	c = deref(q, c, q->st.curr_frame);
+	pl_idx_t c_ctx = q->latest_ctx;
+	const db_run *run, *others;
 
-		cell *arg1 = key + 1, *arg2 = NULL, *arg3 = NULL;
+	if (!search_switch(q, pr, sw, c, c_ctx, &run, &others))
+		return false;
 
-		if (key->arity > 1)
-			arg2 = arg1 + arg1->nbr_cells;
+	q->st.run1 = run;
+	q->st.run2 = others->nbr ? others : NULL;
+	q->st.run1_pos = run ? run->first : 0;
+	q->st.run2_pos = others->first;
 
-		if (key->arity > 2)
-			arg3 = arg2 + arg2->nbr_cells;
+	if (!(q->st.curr_clause = next_in_runs(q, true)))
+		q->st.run1 = q->st.run2 = NULL;
 
-		arg1 = deref(q, arg1, q->st.curr_frame);
+	return true;
+}
 
-		if (arg2)
-			arg2 = deref(q, arg2, q->st.curr_frame);
+// The first argument couldn't select, so use the first other bound
+// argument that has (or can be given) a switch...
 
-		if (arg3)
-			arg3 = deref(q, arg3, q->st.curr_frame);
+static void find_in_jit(query *q, predicate *pr, cell *key)
+{
+	cell *c = key + 1;
 
-		if (q->pl->opt && is_ground(arg1))
-			q->st.arg1_is_ground = true;
+	for (unsigned i = 1; i < key->arity; i++) {
+		c += c->nbr_cells;
+		cell *arg = deref(q, c, q->st.curr_frame);
 
-		if (q->pl->opt && arg2 && is_ground(arg2))
-			q->st.arg2_is_ground = true;
+		if (is_variable(arg))
+			continue;
 
-		if (q->pl->opt && arg3 && is_ground(arg3))
-			q->st.arg3_is_ground = true;
+		db_switch *sw = get_jit_switch(pr, i, arg);
 
-		return;
+		if (sw && find_in_switch(q, pr, sw, key, i))
+			return;
 	}
+}
 
-	//sl_dump(pr->idx, dump_key, q);
-
-	key = deep_clone_to_heap(q, key, q->st.curr_frame);
+static void find_key(query *q, predicate *pr, cell *key)
+{
+	q->st.arg1_is_ground = false;
+	q->st.arg2_is_ground = false;
+	q->st.arg3_is_ground = false;
+	q->st.run1 = q->st.run2 = NULL;
+	q->st.curr_clause = pr->head;
 
-	if (is_all_vars(key)) {
-		q->st.curr_clause = pr->head;
+	if (!key->arity)
 		return;
-	}
-
-	q->st.curr_clause = NULL;
-	miter *iter;
 
-	if (!(iter = m_find_key(pr->idx, key))) {
-		//DUMP_TERM("*** not found, key = ", key, q->st.curr_frame);
-		return;
+	if (!pr->sw || !find_in_switch(q, pr, pr->sw, key, 0)) {
+		if (key->arity > 1)
+			find_in_jit(q, pr, key);
 	}
 
-	if (!m_next_key(iter, (void*)&q->st.curr_clause))
+	if (pr->is_multifile || pr->is_dynamic)
 		return;
 
-	// If the index search has found just one (definite) solution
-	// then we can use it with no problems. If more than one then
-	// results must be returned in database order, so prefetch all
-	// the results and return them sorted as an iterator...
+	cell *arg1 = key + 1, *arg2 = NULL, *arg3 = NULL;
 
-	map *tmp_list = NULL;
-	db_entry *dbe;
+	if (key->arity > 1)
+		arg2 = arg1 + arg1->nbr_cells;
 
-	while (m_next_key(iter, (void*)&dbe)) {
-		if (!tmp_list) {
-			tmp_list = m_create(NULL, NULL, NULL);
-			m_allow_dups(tmp_list, false);
-			m_set_tmp(tmp_list);
-			m_app(tmp_list, (void*)q->st.curr_clause->db_id, q->st.curr_clause);
-		}
+	if (key->arity > 2)
+		arg3 = arg2 + arg2->nbr_cells;
 
-		m_app(tmp_list, (void*)dbe->db_id, (void*)dbe);
-	}
+	arg1 = deref(q, arg1, q->st.curr_frame);
 
-	// FIXME: make sure a cut or backtrack calls m_done(q->st.iter)
+	if (arg2)
+		arg2 = deref(q, arg2, q->st.curr_frame);
 
-	if (tmp_list) {
-		q->st.iter = m_first(tmp_list);
-		m_next(q->st.iter, (void*)&q->st.curr_clause);
-		return;
-	}
+	if (arg3)
+		arg3 = deref(q, arg3, q->st.curr_frame);
+
+	if (q->pl->opt && is_ground(arg1))
+		q->st.arg1_is_ground = true;
+
+	if (q->pl->opt && arg2 && is_ground(arg2))
+		q->st.arg2_is_ground = true;
 
-	q->st.definite = true;
+	if (q->pl->opt && arg3 && is_ground(arg3))
+		q->st.arg3_is_ground = true;
 }
 
 size_t scan_is_chars_list2(query *q, cell *l, pl_idx_t l_ctx, bool allow_codes, bool *has_var, bool *is_partial)
@@ -461,6 +496,12 @@ static void unwind_trail(query *q, const choice *ch)
 	while (q->st.tp > ch->st.tp) {
 		const trail *tr = q->trails + --q->st.tp;
 		const frame *f = GET_FRAME(tr->ctx);
+
+		// The frame may have been popped (and reused) since...
+
+		if (tr->var_nbr >= f->nbr_vars)
+			continue;
+
 		slot *e = GET_SLOT(f, tr->var_nbr);
 		unshare_cell(&e->c);
 		e->c.tag = TAG_EMPTY;
@@ -483,6 +524,7 @@ pl_status try_me(query *q, unsigned nbr_vars)
 	frame *f = GET_FRAME(q->st.fp);
 	f->nbr_slots = f->nbr_vars = nbr_vars;
 	f->base_slot_nbr = q->st.sp;
+	f->min_ref = q->st.fp;
 	slot *e = GET_FIRST_SLOT(f);
 
 	for (unsigned i = 0; i < nbr_vars; i++, e++) {
@@ -496,29 +538,13 @@ pl_status try_me(query *q, unsigned nbr_vars)
 	q->cycle_error = false;
 	q->check_unique = false;
 	q->has_vars = false;
-	q->no_tco = false;
 	q->tot_matches++;
 	return pl_success;
 }
 
 static void trim_heap(query *q, const choice *ch)
 {
-	for (page *a = q->pages; a;) {
-		if (a->nbr <= ch->st.curr_page)
-			break;
-
-		for (pl_idx_t i = 0; i < a->max_hp_used; i++) {
-			cell *c = a->heap + i;
-			unshare_cell(c);
-			c->tag = TAG_EMPTY;
-			c->attrs = NULL;
-		}
-
-		page *save = a;
-		q->pages = a = a->next;
-		free(save->heap);
-		free(save);
-	}
+	trim_pages(q, ch->st.curr_page);
 
 #if 0
 	const page *a = q->pages;
@@ -556,6 +582,19 @@ LOOP:
 
 	trim_heap(q, ch);
 	q->st = ch->st;
+
+	if (ch->has_aux) {
+		const choice_aux *a = q->choice_auxs + curr_choice;
+		q->aux.curr_clause2 = a->curr_clause2;
+		q->aux.pr2 = a->pr2;
+		q->aux.f_iter = a->f_iter;
+		q->aux.prob = a->prob;
+	} else {
+		q->aux.curr_clause2 = NULL;
+		q->aux.pr2 = NULL;
+		q->aux.f_iter = NULL;
+		q->aux.prob = 1.0;
+	}
 	q->save_m = NULL;		// maybe move q->save_m to q->st.save_m
 
 	frame *f = GET_CURR_FRAME();
@@ -564,6 +603,7 @@ LOOP:
 	f->nbr_vars = ch->nbr_vars;
 	f->nbr_slots = ch->nbr_slots;
 	f->overflow = ch->overflow;
+	trim_stacks(q);
 	return true;
 }
 
@@ -593,40 +633,183 @@ static frame *push_frame(query *q, unsigned nbr_vars)
 	return f;
 }
 
-static void reuse_frame(query *q, unsigned nbr_vars)
+// The size of a term if it is ground (once dereferenced) and no
+// bigger than 'budget' cells, else zero...
+
+static pl_idx_t ground_size(query *q, cell *p1, pl_idx_t p1_ctx, pl_idx_t budget)
 {
-	const frame *newf = GET_FRAME(q->st.fp);
-	frame *f = GET_CURR_FRAME();
+	if (!budget)
+		return 0;
 
-	const choice *ch = GET_CURR_CHOICE();
-	q->st.sp = ch->st.sp;
+	cell *c = deref(q, p1, p1_ctx);
+	pl_idx_t c_ctx = q->latest_ctx;
+
+	if (is_variable(c))
+		return 0;
+
+	if (!is_structure(c))
+		return 1;
+
+	pl_idx_t n = 1;
+	unsigned arity = c->arity;
+	c++;
+
+	while (arity--) {
+		pl_idx_t n2 = ground_size(q, c, c_ctx, budget - n);
 
-	slot *from = GET_FIRST_SLOT(newf);
-	slot *to = GET_FIRST_SLOT(f);
+		if (!n2)
+			return 0;
 
-	for (pl_idx_t i = 0; i < nbr_vars; i++) {
-		unshare_cell(&to->c);
-		*to++ = *from++;
+		n += n2;
+		c += c->nbr_cells;
 	}
 
-#if 0
-	// If the new frame is smaller then the current one.
-	// I don't think this is possible at the moment...
+	return n;
+}
+
+static cell *copy_ground(query *q, cell *dst, cell *p1, pl_idx_t p1_ctx)
+{
+	cell *c = deref(q, p1, p1_ctx);
+	pl_idx_t c_ctx = q->latest_ctx;
+	cell *save_dst = dst;
+	*dst++ = *c;
+	share_cell(c);
+
+	if (!is_structure(c))
+		return dst;
+
+	unsigned arity = c->arity;
+	c++;
 
-	for (unsigned i = nbr_vars; i < f->nbr_vars; i++, to++) {
-		unshare_cell(&to->c);
-		to->c.tag = TAG_EMPTY;
-		to->c.attrs = NULL;
+	while (arity--) {
+		dst = copy_ground(q, dst, c, c_ctx);
+		c += c->nbr_cells;
 	}
-#endif
 
-	f->cgen = newf->cgen;
+	save_dst->nbr_cells = dst - save_dst;
+	return dst;
+}
+
+// A callee slot may not refer to the frames [lo,hi) being dropped.
+// Bindings to other variables there are followed, and small ground
+// terms copied to the heap. Anything else stops the reuse...
+
+#define MAX_LCO_COPY 64
+
+static bool move_slot(query *q, slot *e, pl_idx_t lo, pl_idx_t hi)
+{
+	if (is_empty(&e->c))
+		return !e->c.attrs;
+
+	cell *c = &e->c;
+	pl_idx_t c_ctx = e->ctx;
+
+	while (is_variable(c) && (c_ctx >= lo) && (c_ctx < hi)) {
+		slot *e2 = GET_SLOT(GET_FRAME(c_ctx), c->var_nbr);
+
+		if (is_empty(&e2->c))
+			return false;
+
+		c = &e2->c;
+		c_ctx = e2->ctx;
+	}
+
+	cell tmp = *c;
+
+	if (is_indirect(c) && (c_ctx >= lo) && (c_ctx < hi)) {
+		pl_idx_t n = ground_size(q, c->val_ptr, c_ctx, MAX_LCO_COPY);
+
+		if (!n)
+			return false;
+
+		cell *tmp2 = alloc_on_heap(q, n);
+
+		if (!tmp2)
+			return false;
+
+		copy_ground(q, tmp2, c->val_ptr, c_ctx);
+		make_indirect(&tmp, tmp2);
+		c_ctx = 0;
+	} else if (c == &e->c)
+		return true;
+
+	share_cell(&tmp);
+	unshare_cell(&e->c);
+	e->c = tmp;
+	e->ctx = c_ctx;
+	return true;
+}
+
+// Last-call optimisation: the callee's slots are moved down over the
+// current frame (and any above it) and the callee runs in its place.
+// This needs no choices and no references into those frames from
+// older ones, which 'min_ref' (lowered by set_var) keeps track of.
+
+static bool reuse_frame(query *q, unsigned nbr_vars)
+{
+	pl_idx_t curr = q->st.curr_frame, new_frame = q->st.fp;
+	frame *f = GET_FRAME(curr);
+	const frame *newf = GET_FRAME(new_frame);
+
+	if ((newf->base_slot_nbr != q->st.sp) || q->run_hook || q->in_hook)
+		return false;
+
+	// Any choice made since entering the current frame would need it
+	// (the one on top is this call's own, about to be dropped)...
+
+	if ((q->cp > 1) && (GET_CHOICE(q->cp-2)->st.fp > curr))
+		return false;
+
+	for (pl_idx_t i = new_frame + 1; i-- > curr;) {
+		if (GET_FRAME(i)->min_ref < curr)
+			return false;
+	}
+
+	for (unsigned i = 0; i < nbr_vars; i++) {
+		if (!move_slot(q, GET_SLOT(newf, i), curr, new_frame))
+			return false;
+	}
+
+	pl_idx_t tp = q->cp > 1 ? GET_CHOICE(q->cp-2)->st.tp : 0;
+
+	while (!q->undo_hi_tp && (q->st.tp > tp)) {
+		const trail *tr = q->trails + q->st.tp - 1;
+
+		if (tr->ctx < curr)
+			break;
+
+		q->st.tp--;
+	}
+
+	slot *from = q->slots + newf->base_slot_nbr;
+	slot *to = q->slots + f->base_slot_nbr;
+
+	for (slot *e = to; e < from; e++) {
+		unshare_cell(&e->c);
+		e->c.tag = TAG_EMPTY;
+		e->c.attrs = NULL;
+	}
+
+	memmove(to, from, sizeof(slot)*nbr_vars);
+
+	for (slot *e = to + nbr_vars; e < from + nbr_vars; e++) {
+		e->c.tag = TAG_EMPTY;
+		e->c.attrs = NULL;
+	}
+
+	for (unsigned i = 0; i < nbr_vars; i++, to++) {
+		if (to->ctx == new_frame)
+			to->ctx = curr;
+	}
+
+	f->cgen = ++q->cgen;
 	f->nbr_slots = nbr_vars;
 	f->nbr_vars = nbr_vars;
 	f->overflow = 0;
-
+	q->st.fp = curr + 1;
 	q->st.sp = f->base_slot_nbr + nbr_vars;
 	q->tot_tcos++;
+	return true;
 }
 
 void trim_trail(query *q)
@@ -657,26 +840,6 @@ void trim_trail(query *q)
 	}
 }
 
-static bool check_slots(const query *q, frame *f, clause *r)
-{
-	if (r != NULL) {
-		if (f->nbr_vars != r->nbr_vars)
-			return false;
-	}
-
-	for (unsigned i = 0; i < f->nbr_vars; i++) {
-		const slot *e = GET_SLOT(f, i);
-
-		if (is_indirect(&e->c))
-			return false;
-
-		if (is_managed(&e->c))
-			return false;
-	}
-
-	return true;
-}
-
 void share_predicate(predicate *pr)
 {
 	if (!pr)
@@ -693,6 +856,8 @@ void unshare_predicate(query *q, predicate *pr)
 	if (--pr->ref_cnt != 0)
 		return;
 
+	purge_stale_switches(pr);
+
 	if (!pr->dirty_list)
 		return;
 
@@ -713,6 +878,9 @@ void unshare_predicate(query *q, predicate *pr)
 		if (pr->tail == dbe)
 			pr->tail = dbe->prev;
 
+		remove_from_switches(pr, dbe);
+		remove_from_refs(pr->m, dbe);
+
 		// Now move it to query dirtylist
 
 		db_entry *save = dbe->dirty;
@@ -732,26 +900,15 @@ static void commit_me(query *q, clause *r)
 	q->st.m = q->st.curr_clause->owner->m;
 	bool implied_first_cut = q->check_unique && !q->has_vars && r->is_unique;
 	bool last_match = implied_first_cut || r->is_first_cut || !is_next_key(q, r);
-	bool recursive = is_tail_recursive(q->st.curr_cell);
-	bool choices = any_choices(q, f);
-	bool slots_ok = check_slots(q, f, r);
-	bool tco = last_match && !q->no_tco && recursive && !choices && slots_ok;
-
-#if 0
-	printf("*** tco=%d, q->no_tco=%d, last_match=%d, rec=%d, any_choices=%d, slots_ok=%d\n",
-		tco, q->no_tco, last_match, recursive, choices, slots_ok);
-#endif
+	const cell *next_cell = q->st.curr_cell + q->st.curr_cell->nbr_cells;
 
-	// For now. It would also be good to reduce the number of
-	// slots by the number of temporaries...
+	while (is_end(next_cell) && next_cell->val_ret)
+		next_cell = next_cell->val_ret;
 
-	if (last_match && recursive && !choices && slots_ok
-		&& (r->nbr_vars == r->nbr_temporaries))
-		tco = true;
+	bool last_call = is_end(next_cell) && f->prev_cell;
+	bool tco = q->pl->opt && last_match && last_call;
 
-	if (tco && q->pl->opt)
-		reuse_frame(q, r->nbr_vars);
-	else
+	if (!tco || !reuse_frame(q, r->nbr_vars))
 		f = push_frame(q, r->nbr_vars);
 
 	if (last_match) {
@@ -759,13 +916,13 @@ static void commit_me(query *q, clause *r)
 		f->is_last = true;
 		q->st.curr_clause = NULL;
 		unshare_predicate(q, q->st.pr);
-		m_done(q->st.iter);
-		q->st.iter = NULL;
 		drop_choice(q);
 		trim_trail(q);
 	} else {
 		choice *ch = GET_CURR_CHOICE();
 		ch->st.curr_clause = q->st.curr_clause;
+		ch->st.run1_pos = q->st.run1_pos;
+		ch->st.run2_pos = q->st.run2_pos;
 		ch->cgen = f->cgen;
 	}
 
@@ -779,14 +936,20 @@ void stash_me(query *q, clause *r, bool last_match)
 	pl_idx_t cgen = q->cgen;
 
 	if (last_match) {
-		unshare_predicate(q, q->st.pr2);
+		unshare_predicate(q, q->aux.pr2);
 		drop_choice(q);
 	} else {
 		choice *ch = GET_CURR_CHOICE();
-		ch->st.curr_clause2 = q->st.curr_clause2;
+		choice_aux *a = get_choice_aux(q, ch);
+		if (a) a->curr_clause2 = q->aux.curr_clause2;
 		ch->cgen = cgen = ++q->cgen;
 	}
 
+	// The choice (if any) holds the iteration now...
+
+	q->aux.curr_clause2 = NULL;
+	q->aux.pr2 = NULL;
+
 	unsigned nbr_vars = r->nbr_vars;
 	pl_idx_t new_frame = q->st.fp++;
 	frame *f = GET_FRAME(new_frame);
@@ -798,19 +961,67 @@ void stash_me(query *q, clause *r, bool last_match)
 	q->st.sp += nbr_vars;
 }
 
+// The aux record of a choice, set to the defaults when first used...
+
+choice_aux *get_choice_aux(query *q, choice *ch)
+{
+	pl_idx_t idx = ch - q->choices;
+
+	if (ch->has_aux)
+		return q->choice_auxs + idx;
+
+	if (!q->choice_auxs) {
+		q->choice_auxs = stack_alloc(sizeof(choice_aux), q->choices_size, q->choices_rsvd, &q->choice_auxs_rsvd);
+
+		if (!q->choice_auxs) {
+			q->is_oom = q->error = true;
+			return NULL;
+		}
+
+		q->choice_auxs_size = q->choices_size;
+	}
+
+	if (idx >= q->choice_auxs_size) {
+		pl_idx_t new_size = stack_grow((void**)&q->choice_auxs, sizeof(choice_aux), idx+1, q->choices_size, q->choice_auxs_rsvd);
+
+		if (!new_size) {
+			q->is_oom = q->error = true;
+			return NULL;
+		}
+
+		q->choice_auxs_size = new_size;
+	}
+
+	choice_aux *a = q->choice_auxs + idx;
+	*a = (choice_aux){0};
+	a->prob = 1.0;
+	ch->has_aux = true;
+	return a;
+}
+
 pl_status push_choice(query *q)
 {
 	may_error(check_choice(q));
 	frame *f = GET_CURR_FRAME();
 	pl_idx_t curr_choice = q->cp++;
 	choice *ch = GET_CHOICE(curr_choice);
-	memset(ch, 0, sizeof(choice));
 	ch->st = q->st;
 	ch->ugen = f->ugen;
 	ch->frame_cgen = ch->cgen = f->cgen;
 	ch->nbr_vars = f->nbr_vars;
 	ch->nbr_slots = f->nbr_slots;
 	ch->overflow = f->overflow;
+	ch->flags = 0;
+
+	if (q->aux.curr_clause2 || q->aux.pr2 || q->aux.f_iter || (q->aux.prob != 1.0)) {
+		choice_aux *a = get_choice_aux(q, ch);
+		if (!a) return pl_error;
+		a->curr_clause2 = q->aux.curr_clause2;
+		a->pr2 = q->aux.pr2;
+		a->f_iter = q->aux.f_iter;
+		a->prob = q->aux.prob;
+	}
+
 	return pl_success;
 }
 
@@ -891,10 +1102,9 @@ void cut_me(query *q, bool inner_cut, bool soft_cut)
 			break;
 		}
 
-		if (ch->st.iter)
-			m_done(ch->st.iter);
+		if (ch->has_aux)
+			unshare_predicate(q, q->choice_auxs[ch-q->choices].pr2);
 
-		unshare_predicate(q, ch->st.pr2);
 		unshare_predicate(q, ch->st.pr);
 		q->cp--;
 
@@ -968,6 +1178,94 @@ static void proceed(query *q)
 	}
 }
 
+static pl_idx_t slots_end(const frame *f)
+{
+	pl_idx_t end = f->base_slot_nbr + f->nbr_slots;
+
+	if (f->overflow && ((f->overflow + (f->nbr_vars - f->nbr_slots)) > end))
+		end = f->overflow + (f->nbr_vars - f->nbr_slots);
+
+	return end;
+}
+
+// Environment trimming: on returning to frame 'ctx' the frames above
+// it are done with. Those no choice needs and no older frame refers
+// to are popped, along with their slots. Only the top few frames are
+// looked at, as a chain of frames bound to each other (say building
+// a list in the head) can't be popped anyway...
+
+#define MAX_TRIM_FRAMES 64
+
+static void trim_frames(query *q, pl_idx_t ctx)
+{
+	if (q->run_hook || q->in_hook)
+		return;
+
+	pl_idx_t lo = ctx + 1;
+
+	if ((q->st.fp - lo) > MAX_TRIM_FRAMES)
+		lo = q->st.fp - MAX_TRIM_FRAMES;
+
+	if (q->cp) {
+		const choice *ch = GET_CURR_CHOICE();
+
+		if (ch->st.fp > lo)
+			lo = ch->st.fp;
+	}
+
+	pl_idx_t new_fp = q->st.fp, min_ref = q->st.fp;
+
+	for (pl_idx_t i = q->st.fp; i-- > lo;) {
+		const frame *f = GET_FRAME(i);
+
+		if (f->min_ref < min_ref)
+			min_ref = f->min_ref;
+
+		if (min_ref < lo)
+			break;
+
+		if (min_ref >= i)
+			new_fp = i;
+	}
+
+	if (new_fp == q->st.fp)
+		return;
+
+	pl_idx_t new_sp = GET_FRAME(new_fp)->base_slot_nbr;
+
+	for (pl_idx_t i = ctx; i < new_fp; i++) {
+		pl_idx_t end = slots_end(GET_FRAME(i));
+
+		if (end > new_sp)
+			new_sp = end;
+	}
+
+	for (slot *e = q->slots + new_sp; e < q->slots + q->st.sp; e++) {
+		unshare_cell(&e->c);
+		e->c.tag = TAG_EMPTY;
+		e->c.attrs = NULL;
+	}
+
+	pl_idx_t tp = q->cp ? GET_CURR_CHOICE()->st.tp : 0;
+
+	while (!q->undo_hi_tp && (q->st.tp > tp)) {
+		const trail *tr = q->trails + q->st.tp - 1;
+
+		if (tr->ctx < new_fp)
+			break;
+
+		q->st.tp--;
+	}
+
+	q->tot_trims += q->st.fp - new_fp;
+	q->st.fp = new_fp;
+
+	if (new_sp < q->st.sp)
+		q->st.sp = new_sp;
+
+	trim_stacks(q);
+}
+
 // Resume previous frame...
 
 static bool resume_frame(query *q)
@@ -984,32 +1282,8 @@ static bool resume_frame(query *q)
 	}
 #endif
 
-#if 0
-	if (q->st.curr_clause) {
-		clause *r = &q->st.curr_clause->cl;
-
-		if ((q->st.curr_frame == (q->st.fp-1))
-			&& q->pl->opt
-			&& r->is_tail_rec
-			&& !any_choices(q, f)
-			&& check_slots(q, f, r))
-			q->st.fp--;
-	}
-#endif
-
-#if 0
-	//if ((q->st.curr_frame == (q->st.fp-1)) && f->is_last)
-	//	fprintf(stderr, "*** resume f->is_last=%d, f->is_complex=%d, any_choices=%d\n", f->is_last, f->is_complex, any_choices(q, f));
-
-	if ((q->st.curr_frame == (q->st.fp-1)) && f->is_last
-		&& q->pl->opt
-		&& !f->is_complex
-		&& !any_choices(q, f)
-		&& check_slots(q, f, NULL)) {
-		//fprintf(stderr, "*** trim\n");
-		q->st.fp--;
-	}
-#endif
+	if (q->pl->opt)
+		trim_frames(q, f->prev_frame);
 
 	q->st.curr_cell = f->prev_cell;
 	q->st.curr_frame = f->prev_frame;
@@ -1066,6 +1340,12 @@ unsigned create_vars(query *q, unsigned cnt)
 		pl_idx_t cnt2 = f->nbr_vars - f->nbr_slots;
 		memmove(q->slots+f->overflow, q->slots+save_overflow, sizeof(slot)*cnt2);
 		q->st.sp += cnt2 + cnt;
+
+		for (pl_idx_t i = 0; i < cnt2; i++) {
+			slot *e = q->slots + save_overflow + i;
+			e->c.tag = TAG_EMPTY;
+			e->c.attrs = NULL;
+		}
 	}
 
 	slot *e = GET_SLOT(f, f->nbr_vars);
@@ -1111,6 +1391,9 @@ void set_var(query *q, const cell *c, pl_idx_t c_ctx, cell *v, pl_idx_t v_ctx)
 	e->c.flags &= ~FLAG_VAR_REF;
 	e->ctx = v_ctx;
 
+	if ((c_ctx < v_ctx) && (is_structure(v) || is_variable(v)))
+		pin_frame(q, v_ctx, c_ctx);
+
 	if (q->flags.occurs_check != OCCURS_CHECK_FALSE)
 		e->mark = true;
 }
@@ -1136,6 +1419,9 @@ void reset_var(query *q, const cell *c, pl_idx_t c_ctx, cell *v, pl_idx_t v_ctx,
 
 	e->ctx = v_ctx;
 
+	if ((c_ctx < v_ctx) && (is_structure(v) || is_variable(v)))
+		pin_frame(q, v_ctx, c_ctx);
+
 	if (q->cp && trailing)
 		add_trail(q, c_ctx, c->var_nbr, NULL, 0);
 }
@@ -1167,23 +1453,24 @@ USE_RESULT pl_status match_rule(query *q, cell *p1, pl_idx_t p1_ctx)
 			if (get_builtin(q->pl, GET_STR(q, head), head->arity, &found, NULL), found)
 				return throw_error(q, head, q->latest_ctx, "permission_error", "modify,static_procedure");
 
-			q->st.curr_clause2 = NULL;
+			q->aux.curr_clause2 = NULL;
 			return false;
 		}
 
 		if (!pr->is_dynamic)
 			return throw_error(q, head, q->latest_ctx, "permission_error", "modify,static_procedure");
 
-		q->st.curr_clause2 = pr->head;
-		share_predicate(q->st.pr2=pr);
+		q->aux.curr_clause2 = pr->head;
+		share_predicate(q->aux.pr2=pr);
 		frame *f = GET_FRAME(q->st.curr_frame);
 		f->ugen = q->pl->ugen;
 	} else {
-		q->st.curr_clause2 = q->st.curr_clause2->next;
+		q->aux.curr_clause2 = q->aux.curr_clause2->next;
 	}
 
-	if (!q->st.curr_clause2) {
-		unshare_predicate(q, q->st.pr2);
+	if (!q->aux.curr_clause2) {
+		unshare_predicate(q, q->aux.pr2);
+		q->aux.pr2 = NULL;
 		return pl_failure;
 	}
 
@@ -1193,11 +1480,11 @@ USE_RESULT pl_status match_rule(query *q, cell *p1, pl_idx_t p1_ctx)
 	cell *orig_p1 = p1;
 	const frame *f = GET_FRAME(q->st.curr_frame);
 
-	for (; q->st.curr_clause2; q->st.curr_clause2 = q->st.curr_clause2->next) {
-		if (!can_view(f, q->st.curr_clause2))
+	for (; q->aux.curr_clause2; q->aux.curr_clause2 = q->aux.curr_clause2->next) {
+		if (!can_view(f, q->aux.curr_clause2))
 			continue;
 
-		clause *r = &q->st.curr_clause2->cl;
+		clause *r = &q->aux.curr_clause2->cl;
 		cell *c = r->cells;
 		bool needs_true = false;
 		p1 = orig_p1;
@@ -1233,7 +1520,9 @@ USE_RESULT pl_status match_rule(query *q, cell *p1, pl_idx_t p1_ctx)
 	}
 
 	drop_choice(q);
-	unshare_predicate(q, q->st.pr2);
+	unshare_predicate(q, q->aux.pr2);
+	q->aux.curr_clause2 = NULL;
+	q->aux.pr2 = NULL;
 	return pl_failure;
 }
 
@@ -1267,7 +1556,7 @@ USE_RESULT pl_status match_clause(query *q, cell *p1, pl_idx_t p1_ctx, enum clau
 					return throw_error(q, p1, p1_ctx, "permission_error", "access,private_procedure");
 			}
 
-			q->st.curr_clause2 = NULL;
+			q->aux.curr_clause2 = NULL;
 			return pl_failure;
 		}
 
@@ -1278,16 +1567,17 @@ USE_RESULT pl_status match_clause(query *q, cell *p1, pl_idx_t p1_ctx, enum clau
 				return throw_error(q, p1, p1_ctx, "permission_error", "access,private_procedure");
 		}
 
-		q->st.curr_clause2 = pr->head;
-		share_predicate(q->st.pr2=pr);
+		q->aux.curr_clause2 = pr->head;
+		share_predicate(q->aux.pr2=pr);
 		frame *f = GET_FRAME(q->st.curr_frame);
 		f->ugen = q->pl->ugen;
 	} else {
-		q->st.curr_clause2 = q->st.curr_clause2->next;
+		q->aux.curr_clause2 = q->aux.curr_clause2->next;
 	}
 
-	if (!q->st.curr_clause2) {
-		unshare_predicate(q, q->st.pr2);
+	if (!q->aux.curr_clause2) {
+		unshare_predicate(q, q->aux.pr2);
+		q->aux.pr2 = NULL;
 		return pl_failure;
 	}
 
@@ -1295,11 +1585,11 @@ USE_RESULT pl_status match_clause(query *q, cell *p1, pl_idx_t p1_ctx, enum clau
 	may_error(push_choice(q));
 	const frame *f = GET_FRAME(q->st.curr_frame);
 
-	for (; q->st.curr_clause2; q->st.curr_clause2 = q->st.curr_clause2->next) {
-		if (!can_view(f, q->st.curr_clause2))
+	for (; q->aux.curr_clause2; q->aux.curr_clause2 = q->aux.curr_clause2->next) {
+		if (!can_view(f, q->aux.curr_clause2))
 			continue;
 
-		clause *r = &q->st.curr_clause2->cl;
+		clause *r = &q->aux.curr_clause2->cl;
 		cell *head = get_head(r->cells);
 		cell *body = get_logical_body(r->cells);
 
@@ -1318,7 +1608,9 @@ USE_RESULT pl_status match_clause(query *q, cell *p1, pl_idx_t p1_ctx, enum clau
 	}
 
 	drop_choice(q);
-	unshare_predicate(q, q->st.pr2);
+	unshare_predicate(q, q->aux.pr2);
+	q->aux.curr_clause2 = NULL;
+	q->aux.pr2 = NULL;
 	return pl_failure;
 }
 
@@ -1376,7 +1668,7 @@ static USE_RESULT pl_status match_head(query *q)
 		cell *head = get_head(r->cells);
 		may_error(try_me(q, r->nbr_vars));
 
-		if (unify(q, q->st.curr_cell, q->st.curr_frame, head, q->st.fp)) {
+		if (unify_head(q, q->st.curr_cell, q->st.curr_frame, head, q->st.fp)) {
 			if (q->error) {
 				q->st.pr = NULL;
 				return pl_error;
@@ -1459,19 +1751,19 @@ pl_status start(query *q)
 	bool done = false;
 
 	while (!done && !q->error) {
+		if (g_tpl_interrupt) {
 #ifndef _WIN32
-		if (g_tpl_interrupt == SIGALRM) {
-			g_tpl_interrupt = 0;
-			pl_status ok = throw_error(q, q->st.curr_cell, q->st.curr_frame, "time_limit_exceeded", "timed_out");
+			if (g_tpl_interrupt == SIGALRM) {
+				g_tpl_interrupt = 0;
+				pl_status ok = throw_error(q, q->st.curr_cell, q->st.curr_frame, "time_limit_exceeded", "timed_out");
 
-			if (ok == pl_failure)
-				q->retry = true;
+				if (ok == pl_failure)
+					q->retry = true;
 
-			continue;
-		}
+				continue;
+			}
 #endif
 
-		if (g_tpl_interrupt) {
 			int ok = check_interrupt(q);
 
 			if (!q->st.curr_cell)
@@ -1499,6 +1791,12 @@ pl_status start(query *q)
 				continue;
 		}
 
+		if (q->gc_due)
+			gc_heap(q);
+
+		if (q->pl->atoms_gc_due && !q->live_next && !q->live_prev)
+			gc_atoms(q->pl);
+
 		q->tot_goals++;
 		q->did_throw = false;
 		Trace(q, q->st.curr_cell, q->st.curr_frame, CALL);
@@ -1528,6 +1826,44 @@ pl_status start(query *q)
 				may_error(do_post_unification_hook(q, true));
 
 			proceed(q);
+
+			// Run the builtins that follow in the body straight off,
+			// for as long as there is nothing the top of the loop
+			// would have to see to first...
+
+			bool failed = false;
+
+			while (q->st.curr_cell && !is_end(q->st.curr_cell)
+				&& is_builtin(q->st.curr_cell) && q->st.curr_cell->fn
+				&& !g_tpl_interrupt && !q->gc_due && !q->trace
+				&& !q->error && !q->is_oom && !q->run_hook) {
+				q->resume = false;
+				q->retry = QUERY_OK;
+				q->tot_goals++;
+				q->did_throw = false;
+				q->cycle_error = false;
+				q->before_hook_tp = q->st.tp;
+
+				if ((q->st.curr_cell->fn(q) == pl_failure) && !q->is_oom) {
+					failed = true;
+					break;
+				}
+
+				if (q->run_hook && !q->in_hook)
+					may_error(do_post_unification_hook(q, true));
+
+				proceed(q);
+			}
+
+			if (failed) {
+				q->retry = QUERY_RETRY;
+
+				if (q->yielded)
+					break;
+
+				q->tot_backtracks++;
+				continue;
+			}
 		} else if (is_list(q->st.curr_cell)) {
 			if (consultall(q, q->st.curr_cell, q->st.curr_frame) != pl_success) {
 				q->retry = true;
@@ -1715,7 +2051,7 @@ static void purge_dirty_list(query *q)
 		db_entry *dbe = q->dirty_list;
 		q->dirty_list = dbe->dirty;
 		clear_rule(&dbe->cl);
-		free(dbe);
+		free_db_entry(q->pl, dbe);
 		cnt++;
 	}
 
@@ -1724,6 +2060,14 @@ static void purge_dirty_list(query *q)
 
 void destroy_query(query *q)
 {
+	if (q->live_prev)
+		q->live_prev->live_next = q->live_next;
+	else if (q->pl->queries == q)
+		q->pl->queries = q->live_next;
+
+	if (q->live_next)
+		q->live_next->live_prev = q->live_prev;
+
 	while (q->st.qnbr > 0) {
 		free(q->tmpq[q->st.qnbr]);
 		q->st.qnbr--;
@@ -1755,12 +2099,15 @@ void destroy_query(query *q)
 	for (pl_idx_t i = 0; i < q->st.sp; i++, e++)
 		unshare_cell(&e->c);
 
+	free_pages(q);
 	mp_int_clear(&q->tmp_ival);
 	purge_dirty_list(q);
-	free(q->trails);
-	free(q->choices);
-	free(q->slots);
-	free(q->frames);
+	free(q->tmp_attrs);
+	stack_free(q->trails, sizeof(trail), q->trails_rsvd);
+	stack_free(q->choices, sizeof(choice), q->choices_rsvd);
+	stack_free(q->choice_auxs, sizeof(choice_aux), q->choice_auxs_rsvd);
+	stack_free(q->slots, sizeof(slot), q->slots_rsvd);
+	stack_free(q->frames, sizeof(frame), q->frames_rsvd);
 	free(q->tmp_heap);
 	free(q);
 }
@@ -1778,7 +2125,7 @@ query *create_query(module *m, bool is_task)
 	q->flags = m->flags;
 	q->time_started = q->get_started = get_time_in_usec();
 	q->time_cpu_last_started = q->time_cpu_started = cpu_time_in_usec();
-	q->st.prob = 1.0;
+	q->aux.prob = 1.0;
 	mp_int_init(&q->tmp_ival);
 
 	// Allocate these now...
@@ -1789,10 +2136,11 @@ query *create_query(module *m, bool is_task)
 	q->trails_size = is_task ? INITIAL_NBR_TRAILS/10 : INITIAL_NBR_TRAILS;
 
 	bool error = false;
-	CHECK_SENTINEL(q->frames = calloc(q->frames_size, sizeof(frame)), NULL);
-	CHECK_SENTINEL(q->slots = calloc(q->slots_size, sizeof(slot)), NULL);
-	CHECK_SENTINEL(q->choices = calloc(q->choices_size, sizeof(choice)), NULL);
-	CHECK_SENTINEL(q->trails = calloc(q->trails_size, sizeof(trail)), NULL);
+	unsigned rsvd_div = is_task ? 16 : 1;
+	CHECK_SENTINEL(q->frames = stack_alloc(sizeof(frame), q->frames_size, MAX_NBR_GOALS/rsvd_div, &q->frames_rsvd), NULL);
+	CHECK_SENTINEL(q->slots = stack_alloc(sizeof(slot), q->slots_size, MAX_NBR_SLOTS/rsvd_div, &q->slots_rsvd), NULL);
+	CHECK_SENTINEL(q->choices = stack_alloc(sizeof(choice), q->choices_size, MAX_NBR_CHOICES/rsvd_div, &q->choices_rsvd), NULL);
+	CHECK_SENTINEL(q->trails = stack_alloc(sizeof(trail), q->trails_size, MAX_NBR_TRAILS/rsvd_div, &q->trails_rsvd), NULL);
 
 	// Allocate these later as needed...
 
@@ -1804,9 +2152,15 @@ query *create_query(module *m, bool is_task)
 
 	if (error) {
 		destroy_query (q);
-		q = NULL;
+		return NULL;
 	}
 
+	q->live_next = q->pl->queries;
+
+	if (q->live_next)
+		q->live_next->live_prev = q;
+
+	q->pl->queries = q;
 	return q;
 }
 
@@ -7,6 +7,7 @@ query *create_sub_query(query *q, cell *curr_cell);
 void destroy_query(query *q);
 
 pl_status push_choice(query *q);
+choice_aux *get_choice_aux(query *q, choice *ch);
 pl_status push_barrier(query *q);
 pl_status push_call_barrier(query *q);
 pl_status push_catcher(query *q, enum q_retry type);
@@ -78,6 +79,7 @@ ssize_t getline(char **lineptr, size_t *n, FILE *stream);
 
 int compare(query *q, cell *p1, pl_idx_t p1_ctx, cell *p2, pl_idx_t p2_ctx);
 bool unify(query *q, cell *p1, pl_idx_t p1_ctx, cell *p2, pl_idx_t p2_ctx);
+bool unify_head(query *q, cell *p1, pl_idx_t p1_ctx, cell *head, pl_idx_t h_ctx);
 
 ssize_t print_term_to_buf(query *q, char *dst, size_t dstlen, cell *c, pl_idx_t c_ctx, int running, bool cons, unsigned depth);
 pl_status print_term(query *q, FILE *fp, cell *c, pl_idx_t c_ctx, int running);
@@ -318,14 +318,17 @@ bool sl_app(skiplist *l, const void *key, const void *val)
 	return true;
 }
 
-bool sl_get(const skiplist *l, const void *key, const void **val)
+// Lookup using a different (but consistent) comparison, such as one
+// against a key that isn't in the same form as those stored...
+
+bool sl_get_by(const skiplist *l, const void *key, int (*cmpkey)(const void*, const void*, const void*), const void *p1, const void **val)
 {
 	int k;
 	slnode_t *p, *q = 0;
 	p = l->header;
 
 	for (k = l->level - 1; k >= 0; k--) {
-		while ((q = p->forward[k]) && (l->cmpkey(q->bkt[q->nbr - 1].key, key, l->p) < 0))
+		while ((q = p->forward[k]) && (cmpkey(q->bkt[q->nbr - 1].key, key, p1) < 0))
 			p = q;
 	}
 
@@ -335,12 +338,12 @@ bool sl_get(const skiplist *l, const void *key, const void **val)
 	int imid;
 
 	for (imid = 0; imid < q->nbr; imid++) {
-		if (l->cmpkey(q->bkt[imid].key, key, l->p) == 0)
+		if (cmpkey(q->bkt[imid].key, key, p1) == 0)
 			break;
 	}
 
 	if (imid >= q->nbr)
-		return NULL;
+		return false;
 
 	if (val)
 		*val = q->bkt[imid].val;
@@ -348,6 +351,11 @@ bool sl_get(const skiplist *l, const void *key, const void **val)
 	return true;
 }
 
+bool sl_get(const skiplist *l, const void *key, const void **val)
+{
+	return sl_get_by(l, key, l->cmpkey, l->p, val);
+}
+
 bool sl_del(skiplist *l, const void *key)
 {
 	int k, m;
@@ -425,6 +433,8 @@ void sl_iterate(const skiplist *l, int (*f)(const void*, const void*, const void
 	}
 }
 
+// Visit in order every key not less than the one given...
+
 void sl_find(const skiplist *l, const void *key, int (*f)(const void*, const void*, const void*), const void *p1)
 {
 	slnode_t *p, *q = 0;
@@ -435,26 +445,22 @@ void sl_find(const skiplist *l, const void *key, int (*f)(const void*, const voi
 			p = q;
 	}
 
-	if (!(q = p->forward[0]))
+	if (!(p = p->forward[0]))
 		return;
 
-	int imid = binary_search2(l, q->bkt, key, q->nbr - 1);
-	p = q;
+	int j = 0;
 
-	for (int j = imid; j < p->nbr; j++) {
-		if (!f(p->bkt[j].key, p->bkt[j].val, p1))
-			return;
-	}
+	while ((j < p->nbr) && (l->cmpkey(p->bkt[j].key, key, l->p) < 0))
+		j++;
 
 	while (p) {
-		slnode_t *q = p->forward[0];
-
-		for (int j = 0; j < p->nbr; j++) {
+		for (; j < p->nbr; j++) {
 			if (!f(p->bkt[j].key, p->bkt[j].val, p1))
 				return;
 		}
 
-		p = q;
+		p = p->forward[0];
+		j = 0;
 	}
 }
 
@@ -17,6 +17,13 @@ extern void sl_allow_dups(skiplist *l, bool mode);
 extern bool sl_set(skiplist *l, const void *k, const void *v);
 extern bool sl_app(skiplist *l, const void *k, const void *v);
 extern bool sl_get(const skiplist *l, const void *k, const void **v);
+extern bool sl_get_by(
+	const skiplist *l,
+	const void *k,
+	int (*cmpkey)(const void *k1, const void *k2, const void* p),
+	const void *p,
+	const void **v
+	);
 extern bool sl_del(skiplist *l, const void *k);
 
 extern void sl_iterate(
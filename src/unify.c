@@ -58,8 +58,12 @@ static int compare_internal(query *q, cell *p1, pl_idx_t p1_ctx, cell *p2, pl_id
 		return -1;
 	}
 
-	if (is_iso_atom(p1) && is_iso_atom(p2))
+	if (is_iso_atom(p1) && is_iso_atom(p2)) {
+		if (is_literal(p1) && is_literal(p2))
+			return compare_atoms(q->pl, p1->val_off, p2->val_off);
+
 		return CMP_SLICES(q, p1, p2);
+	}
 
 	if (is_string(p1) && is_string(p2))
 		return CMP_SLICES(q, p1, p2);
@@ -114,7 +118,8 @@ static int compare_internal(query *q, cell *p1, pl_idx_t p1_ctx, cell *p2, pl_id
 		return compare_internal(q, p1, p1_ctx, p2, p2_ctx, depth+1);
 	}
 
-	int val = CMP_SLICES(q, p1, p2);
+	int val = is_literal(p1) && is_literal(p2) ?
+		compare_atoms(q->pl, p1->val_off, p2->val_off) : CMP_SLICES(q, p1, p2);
 	if (val) return val>0?1:-1;
 
 	int arity = p1->arity;
@@ -1110,9 +1115,6 @@ bool unify_internal(query *q, cell *p1, pl_idx_t p1_ctx, cell *p2, pl_idx_t p2_c
 	} else if (is_variable(p1))
 		q->has_vars = true;
 
-	if (p1_ctx == q->st.curr_frame)
-		q->no_tco = true;
-
 	if (is_variable(p1)) {
 		bool was_cyclic = false;
 
@@ -1185,3 +1187,103 @@ bool unify(query *q, cell *p1, pl_idx_t p1_ctx, cell *p2, pl_idx_t p2_ctx)
 	q->lists_ok = false;
 	return ok;
 }
+
+// Unify a call with a clause head whose variables are in a fresh frame
+// 'h_ctx'. The head's cells are run as they stand, in the way of the
+// WAM's get/unify instructions: a first occurrence of a variable just
+// takes the argument (the frame is newer than any choice so needs no
+// trailing), an atom or small integer is compared in place, and for a
+// compound the functor is checked and its args matched in turn. Any
+// other case goes to the general unifier...
+
+static bool unify_head_arg(query *q, cell *p1, pl_idx_t p1_ctx, cell *h, pl_idx_t h_ctx)
+{
+	p1 = deref(q, p1, p1_ctx);
+	p1_ctx = q->latest_ctx;
+
+	if (is_variable(h)) {
+		const frame *f = GET_FRAME(h_ctx);
+		slot *e = GET_SLOT(f, h->var_nbr);
+
+		if (is_empty(&e->c) && !e->c.attrs && !(p1->flags & FLAG_MANAGED)
+			&& (p1_ctx < h_ctx)) {
+			if (is_structure(p1))
+				make_indirect(&e->c, p1);
+			else
+				e->c = *p1;
+
+			e->c.flags &= ~FLAG_VAR_REF;
+			e->ctx = p1_ctx;
+			return true;
+		}
+
+		h = deref(q, h, h_ctx);
+		h_ctx = q->latest_ctx;
+		return unify_internal(q, p1, p1_ctx, h, h_ctx, 0);
+	}
+
+	if (is_variable(p1)) {
+		q->has_vars = true;
+		set_var(q, p1, p1_ctx, h, h_ctx);
+		return true;
+	}
+
+	if (is_smallint(h) && is_smallint(p1)) {
+		q->check_unique = true;
+		return p1->val_int == h->val_int;
+	}
+
+	if (!is_literal(h) || !is_literal(p1))
+		return unify_internal(q, p1, p1_ctx, h, h_ctx, 0);
+
+	q->check_unique = true;
+
+	if ((p1->val_off != h->val_off) || (p1->arity != h->arity))
+		return false;
+
+	unsigned arity = h->arity;
+	p1++; h++;
+
+	while (arity--) {
+		if (!unify_head_arg(q, p1, p1_ctx, h, h_ctx))
+			return false;
+
+		p1 += p1->nbr_cells;
+		h += h->nbr_cells;
+	}
+
+	return true;
+}
+
+bool unify_head(query *q, cell *p1, pl_idx_t p1_ctx, cell *head, pl_idx_t h_ctx)
+{
+	if (!q->pl->opt || (q->flags.occurs_check != OCCURS_CHECK_FALSE)
+		|| !is_literal(head) || is_iso_list(head))
+		return unify(q, p1, p1_ctx, head, h_ctx);
+
+	if (!is_literal(p1) || (p1->arity != head->arity))
+		return unify(q, p1, p1_ctx, head, h_ctx);
+
+	q->cycle_error = false;
+	q->lists_ok = true;
+	cycle_info info1 = {0}, info2 = {0};
+	q->info1 = &info1;
+	q->info2 = &info2;
+	unsigned arity = head->arity;
+	bool ok = true;
+	p1++; head++;
+
+	while (arity--) {
+		if (!unify_head_arg(q, p1, p1_ctx, head, h_ctx)) {
+			ok = false;
+			break;
+		}
+
+		p1 += p1->nbr_cells;
+		head += head->nbr_cells;
+	}
+
+	q->info1 = q->info2 = NULL;
+	q->lists_ok = false;
+	return ok;
+}
@@ -0,0 +1,29 @@
+% Static first-argument indexing must keep database order,
+% including the clauses with a variable first argument.
+
+t(a, 1).
+t(b, 2).
+t(X, any(X)).
+t(1, int).
+t(1.0, real).
+t(-0.0, zero).
+t(f(x), f1).
+t(f(x,y), f2).
+t(g(_), g1).
+t([a|_], list).
+t("ab", string).
+t(a, 3).
+t(foo, 4).
+t(_, last).
+t(123456789012345678901234567890, big).
+
+main :-
+	forall(member(K, [a, b, c, 1, 1.0, 0.0, f(x), g(1), f(x,y), [a,b], "ab", 123456789012345678901234567890]),
+		(findall(V, t(K, V), L), writeq(K-L), nl)),
+	findall(V, (t(f(_), V), atom(V)), L0),
+	writeq(L0), nl,
+	findall(K-V, t(K, V), L),
+	length(L, N),
+	writeq(N), nl.
+
+:- initialization(main).
@@ -0,0 +1,53 @@
+% Dynamic first-argument indexing must keep database order and the
+% logical update view across asserta, assertz and retract.
+
+:- dynamic(d/2).
+:- dynamic(c/1).
+
+fill :-
+	between(1, 20, I),
+	K is I mod 4,
+	assertz(d(K, I)),
+	fail.
+fill :-
+	asserta(d(_, first)),
+	assertz(d(_, last)),
+	asserta(d(2, zero)),
+	asserta(d(k, 0)).
+
+% Clauses added or removed while iterating are not seen...
+
+update :-
+	d(2, X),
+	asserta(d(2, new(X))),
+	assertz(d(2, new(X))),
+	retract(d(3, _)),
+	fail.
+update.
+
+count(N) :-
+	retract(c(N0)),
+	N1 is N0 + 1,
+	assertz(c(N1)),
+	N1 < 1000, !,
+	count(N).
+count(N) :-
+	c(N).
+
+main :-
+	fill,
+	findall(X, d(2, X), L1), writeq(L1), nl,
+	findall(X, d(k, X), L2), writeq(L2), nl,
+	findall(X, d(9, X), L3), writeq(L3), nl,
+	update,
+	findall(X, d(2, X), L4), writeq(L4), nl,
+	findall(X, d(3, X), L5), writeq(L5), nl,
+	retractall(d(2, _)),
+	findall(K-X, d(K, X), L6), writeq(L6), nl,
+	assertz(c(0)),
+	count(N), writeq(N), nl,
+	abolish(d/2),
+	assertz(d(a, 1)),
+	findall(X, d(a, X), L7), writeq(L7), nl.
+
+:- initialization(main).
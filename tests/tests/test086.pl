@@ -0,0 +1,52 @@
+% Ground compound first arguments select clauses through the ordered
+% index, keeping database order with the clauses that could match
+% any key (variables, strings and non-ground compounds).
+
+:- set_prolog_flag(indexing_threshold, 4).
+:- dynamic(p/2).
+
+s(pt(1,1), a).
+s(pt(1,2), b).
+s(pt(_,2), c).
+s(pt(2,1), d).
+s(pt(1,1), e).
+s(_, f).
+s(pt(2,2), g).
+s(pt("ab",1), h).
+s(pt([a,b],1), i).
+s(pt(1.0,1), j).
+s(pt(1,1), k).
+
+fill :-
+	between(1, 30, I),
+	X is I mod 3,
+	Y is I mod 2,
+	assertz(p(q(X,Y), I)),
+	fail.
+fill :-
+	asserta(p(q(_,1), first)),
+	assertz(p(q(1,_), last)).
+
+drop :-
+	retract(p(q(1,1), 1)),
+	retract(p(q(1,1), 7)),
+	retract(p(q(2,0), _)),
+	fail.
+drop.
+
+main :-
+	findall(V, s(pt(1,1), V), L1), writeq(L1), nl,
+	findall(V, s(pt(1,2), V), L2), writeq(L2), nl,
+	findall(V, s(pt([a,b],1), V), L3), writeq(L3), nl,
+	findall(V, s(pt(1.0,1), V), L4), writeq(L4), nl,
+	findall(V, s(pt(3,3), V), L5), writeq(L5), nl,
+	fill,
+	findall(V, p(q(1,1), V), L6), writeq(L6), nl,
+	findall(V, p(q(2,0), V), L7), writeq(L7), nl,
+	drop,
+	findall(V, p(q(1,1), V), L8), writeq(L8), nl,
+	findall(V, p(q(2,0), V), L9), writeq(L9), nl,
+	findall(V, (p(q(1,1), V), assertz(p(q(1,1), again(V)))), L10), writeq(L10), nl,
+	findall(V, p(q(1,1), V), L11), writeq(L11), nl.
+
+:- initialization(main).
@@ -0,0 +1,42 @@
+% Calls with an unbound first argument select clauses using a switch
+% built on demand for another bound argument, keeping database order.
+
+:- dynamic(e/3).
+
+edge(a, b, 1).
+edge(a, c, 2).
+edge(b, c, 3).
+edge(c, d, 4).
+edge(d, e, 5).
+edge(e, a, 6).
+edge(X, X, self).
+edge(b, d, 7).
+edge(c, a, 8).
+edge(d, a, 9).
+
+fill :-
+	between(1, 40, I),
+	X is I mod 5,
+	Y is I mod 7,
+	assertz(e(X, Y, I)),
+	fail.
+fill :-
+	asserta(e(_, 3, first)),
+	assertz(e(_, _, last)).
+
+main :-
+	findall(X-W, edge(X, a, W), L1), writeq(L1), nl,
+	findall(X-W, edge(X, d, W), L2), writeq(L2), nl,
+	findall(X-Y, edge(X, Y, 5), L3), writeq(L3), nl,
+	findall(X-Y, edge(X, Y, 99), L4), writeq(L4), nl,
+	fill,
+	findall(W, e(_, 3, W), L5), writeq(L5), nl,
+	retract(e(0, 3, 10)),
+	assertz(e(9, 3, new)),
+	findall(W, e(_, 3, W), L6), writeq(L6), nl,
+	findall(X-Y, e(X, Y, 17), L7), writeq(L7), nl,
+	statistics(indexes, Is),
+	findall(I, (member(I, Is), I = (N/_-_), memberchk(N, [edge,e])), L8),
+	msort(L8, L9), writeq(L9), nl.
+
+:- initialization(main).
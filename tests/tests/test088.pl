@@ -0,0 +1,53 @@
+% Long runs of one name/arity are split on the first argument of the
+% compound (or the head of a list) when the call's argument isn't
+% ground, keeping database order with clauses that could match.
+
+:- set_prolog_flag(indexing_threshold, 4).
+:- dynamic(h/2).
+
+handle(msg(login, _), login).
+handle(msg(logout, _), logout).
+handle(msg(_, _), any).
+handle(msg(ping, _), pong).
+handle(_, other).
+handle(msg(login, _), again).
+handle(msg(f(1), _), f).
+handle(msg(1.0, _), real).
+handle("ab", string).
+handle(msg(ping, x), ping_x).
+
+l([a|_], a1).
+l([b|_], b1).
+l([a,b|_], a2).
+l([_|_], any).
+l([a], a3).
+l([c|_], c1).
+l(_, last).
+
+fill :-
+	between(1, 20, I),
+	K is I mod 4,
+	assertz(h(m(K, _), I)),
+	fail.
+fill :-
+	asserta(h(_, first)),
+	assertz(h(m(_, x), last)).
+
+main :-
+	T = login,
+	findall(R, handle(msg(T, _), R), L1), writeq(L1), nl,
+	findall(R, handle(msg(ping, _), R), L2), writeq(L2), nl,
+	findall(R, handle(msg(f(_), _), R), L3), writeq(L3), nl,
+	findall(R, handle(msg(1.0, _), R), L4), writeq(L4), nl,
+	findall(R, handle(msg(nope, _), R), L5), writeq(L5), nl,
+	findall(R, l([a|_], R), L6), writeq(L6), nl,
+	findall(R, l([c,d], R), L7), writeq(L7), nl,
+	fill,
+	findall(R, h(m(2, _), R), L8), writeq(L8), nl,
+	retract(h(m(2, _), 6)),
+	asserta(h(m(2, _), new)),
+	assertz(h(_, end)),
+	findall(R, h(m(2, _), R), L9), writeq(L9), nl,
+	findall(R, h(m(3, y), R), L10), writeq(L10), nl.
+
+:- initialization(main).
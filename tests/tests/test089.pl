@@ -0,0 +1,36 @@
+% Indexes declared with index/1 are built for just the marked
+% argument positions and kept up to date on assert and retract.
+
+:- index(person(0,1,1)).
+:- dynamic(person/3).
+
+person(alice, 30, london).
+person(bob, 25, paris).
+person(carol, 30, paris).
+person(dave, 41, london).
+person(_, 99, nowhere).
+
+fill :-
+	between(1, 30, I),
+	A is 20 + I mod 5,
+	C is I mod 3,
+	assertz(person(I, A, C)),
+	fail.
+fill.
+
+main :-
+	findall(N, person(N, 30, _), L1), writeq(L1), nl,
+	findall(N, person(N, _, paris), L2), writeq(L2), nl,
+	findall(N-A, person(N, A, london), L3), writeq(L3), nl,
+	fill,
+	findall(N, person(N, 22, 1), L4), writeq(L4), nl,
+	retract(person(7, 22, 1)),
+	asserta(person(new, 22, 1)),
+	findall(N, person(N, 22, 1), L5), writeq(L5), nl,
+	findall(N, person(N, 99, _), L6), length(L6, Len), writeq(Len), nl,
+	predicate_property(person(_,_,_), index(I)), writeq(I), nl,
+	statistics(indexes, Is),
+	findall(X, (member(X, Is), X = (person/_-_)), L7),
+	msort(L7, L8), writeq(L8), nl.
+
+:- initialization(main).
@@ -0,0 +1,39 @@
+% index_range/4 calls a goal for each value of an argument within a
+% range, in order, with clauses having a variable there matching each.
+
+:- dynamic(price/2).
+:- dynamic(tick/3).
+
+price(apple, 150).
+price(bread, 99).
+price(cheese, 100).
+price(dates, 199.5).
+price(eggs, 200).
+price(flour, 120).
+price(grapes, 100.0).
+price(honey, foo).
+price(ice, 150).
+
+fill :-
+	between(1, 50, I),
+	T is I * 10,
+	V is I mod 7,
+	assertz(tick(T, btc, V)),
+	assertz(tick(T, eth, V)),
+	fail.
+fill.
+
+main :-
+	findall(I-P, index_range(price(I,P), 2, 100, 199.9), L1), writeq(L1), nl,
+	findall(I, index_range(price(I,_), 1, bread, eggs), L2), writeq(L2), nl,
+	findall(P, index_range(price(_,P), 2, 99.5, 120), L3), writeq(L3), nl,
+	findall(P, index_range(price(_,P), 2, a, z), L4), writeq(L4), nl,
+	findall(I, index_range(price(I,_), 2, 300, 400), L5), writeq(L5), nl,
+	fill,
+	findall(T-V, index_range(tick(T,eth,V), 1, 95, 140), L6), writeq(L6), nl,
+	retract(tick(120, eth, _)),
+	findall(T, index_range(tick(T,btc,_), 1, 110, 130), L7), writeq(L7), nl,
+	findall(T, index_range(tick(T,eth,_), 1, 110, 130), L8), writeq(L8), nl,
+	catch(index_range(price(_,_), 2, _, 10), E, true), writeq(E), nl.
+
+:- initialization(main).
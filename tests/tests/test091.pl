@@ -0,0 +1,40 @@
+% Compound first arguments that are only ground once their variables
+% are dereferenced are looked up in the ordered index as they are.
+
+:- set_prolog_flag(indexing_threshold, 4).
+:- dynamic(p/2).
+
+s(f(g(1), a), one_a).
+s(f(g(2), a), two_a).
+s(f(g(1), b), one_b).
+s(f(_, a), any_a).
+s(f(g(1), a), one_a_again).
+s(f(g(1.0), a), real_a).
+s(f(g([x,y]), a), list_a).
+s(f(g("xy"), a), string_a).
+s(f(h(1), a), h_a).
+
+fill :-
+	between(1, 20, I),
+	K is I mod 5,
+	assertz(p(k(w(K), [K]), I)),
+	fail.
+fill.
+
+look(X, Y, L) :-
+	findall(V, s(f(g(X), Y), V), L).
+
+main :-
+	look(1, a, L1), writeq(L1), nl,
+	A = a, G = g(1),
+	findall(V, s(f(G, A), V), L2), writeq(L2), nl,
+	look(1.0, a, L3), writeq(L3), nl,
+	X = x, look([X,y], a, L4), writeq(L4), nl,
+	look(3, a, L5), writeq(L5), nl,
+	fill,
+	K = 3, W = w(K),
+	findall(V, p(k(W, [K]), V), L6), writeq(L6), nl,
+	retract(p(k(w(3), [3]), 8)),
+	findall(V, p(k(W, [K]), V), L7), writeq(L7), nl.
+
+:- initialization(main).
@@ -0,0 +1,28 @@
+% Clause references from assert/2 are found by instance/2, clause/3
+% and erase/1, and stop being found once the clause is erased.
+
+:- dynamic(obj/2).
+
+fill(N, Refs) :-
+	findall(R, (between(1, N, I), assertz(obj(I, v(I)), R)), Refs).
+
+main :-
+	fill(200, Refs),
+	nth1(50, Refs, R50),
+	instance(R50, T), writeq(T), nl,
+	clause(H, B, R50), writeq(H-B), nl,
+	erase(R50),
+	(	catch(instance(R50, _), _, fail) -> writeq(found) ; writeq(gone) ), nl,
+	(	clause(_, _, R50) -> writeq(found) ; writeq(gone) ), nl,
+	findall(I, obj(I, _), L), length(L, Len), writeq(Len), nl,
+	nth1(1, Refs, R1),
+	asserta(obj(first, x), R0),
+	instance(R0, T0), writeq(T0), nl,
+	retract(obj(1, _)),
+	(	clause(_, _, R1) -> writeq(found) ; writeq(gone) ), nl,
+	forall((member(R, Refs), R \== R50, R \== R1), erase(R)),
+	findall(X, obj(X, _), L2), writeq(L2), nl,
+	asserta(obj(again, y), R0b),
+	instance(R0b, Tb), writeq(Tb), nl.
+
+:- initialization(main).
@@ -0,0 +1,31 @@
+% Clauses found unique when loaded still give every solution, where
+% later clauses match through variables, strings or lists, and those
+% added by assert aren't taken as unique.
+
+:- dynamic(g/1).
+
+s(1, a, "ab").
+s(2, b, [a,b]).
+s(X, c, X).
+s(1, d, "ab").
+s(3, e, f(_)).
+s(3, f, f(1)).
+s(1.0, g, "ab").
+s(4, h, "xy").
+
+t("ab").
+t(ab).
+t([a,b]).
+t("ab").
+
+main :-
+	findall(V, s(1, V, _), L1), writeq(L1), nl,
+	findall(V, s(_, V, [a,b]), L2), writeq(L2), nl,
+	findall(V, s(3, V, f(1)), L3), writeq(L3), nl,
+	findall(V, s(4, V, "xy"), L4), writeq(L4), nl,
+	findall(x, t("ab"), L5), writeq(L5), nl,
+	findall(x, t(ab), L6), writeq(L6), nl,
+	assertz(g(1)), asserta(g(3)), assertz(g(3)),
+	findall(x, g(3), L7), writeq(L7), nl.
+
+:- initialization(main).
@@ -0,0 +1,26 @@
+% The heap is collected while a deterministic query runs, leaving the
+% terms still in use alone.
+
+build(0, []) :- !.
+build(N, [L|Ls]) :-
+	atom_codes(hello_world, L),
+	N1 is N - 1,
+	build(N1, Ls).
+
+total([], S, S).
+total([L|Ls], S0, S) :-
+	length(L, N),
+	S1 is S0 + N,
+	total(Ls, S1, S).
+
+main :-
+	build(20000, Ls),
+	total(Ls, 0, S),
+	writeq(S), nl,
+	statistics(garbage_collection, [N, Freed, Time]),
+	( N > 0 -> writeq(collected) ; writeq(not_collected) ), nl,
+	( integer(Freed), integer(Time) -> writeq(ok) ; writeq(bad) ), nl,
+	statistics(gctime, T),
+	( float(T) -> writeq(ok) ; writeq(bad) ), nl.
+
+:- initialization(main).
@@ -0,0 +1,33 @@
+% Last calls reuse the caller's frame, so mutual recursion and state
+% machines run in constant frame space.
+
+even(0) :- !.
+even(N) :- N1 is N - 1, odd(N1).
+
+odd(N) :- N1 is N - 1, even(N1).
+
+step(s(N, Acc), s(N1, Acc1)) :- N1 is N + 1, Acc1 is Acc + N.
+
+run(S, Max, Acc) :-
+	S = s(N, Acc0),
+	(	N >= Max
+	->	Acc = Acc0
+	;	step(S, S1),
+		run(S1, Max, Acc)
+	).
+
+count([], N, N).
+count([_|T], N0, N) :- N1 is N0 + 1, count(T, N1, N).
+
+main :-
+	even(1000000),
+	run(s(0, 0), 1000000, Acc),
+	writeq(Acc), nl,
+	length(L, 1000),
+	count(L, 0, Len),
+	writeq(Len), nl,
+	statistics(frames, [Max, LastCalls, _]),
+	( Max < 2000 -> writeq(bounded) ; writeq(Max) ), nl,
+	( LastCalls > 2000000 -> writeq(ok) ; writeq(LastCalls) ), nl.
+
+:- initialization(main).
@@ -0,0 +1,29 @@
+% Frames are popped as soon as a deterministic call returns, unless
+% an older frame still refers to them.
+
+down(0) :- !.
+down(N) :- N1 is N - 1, down(N1), done(N).
+
+done(_).
+
+pair(X, Y, P) :- wrap(X, A), wrap(Y, B), P = A-B.
+
+wrap(X, w(X, Z)) :- helper(Z).
+
+helper(Z) :- atom_length(abc, Z).
+
+build(0, []) :- !.
+build(N, [X|Xs]) :- N1 is N - 1, build(N1, Xs), pair(N, N1, X).
+
+main :-
+	down(100000),
+	statistics(frames, [_, _, Trimmed]),
+	( Trimmed >= 100000 -> writeq(trimmed) ; writeq(Trimmed) ), nl,
+	build(3, L),
+	writeq(L), nl,
+	length(L2, 2),
+	pair(L2, "s", P),
+	L2 = [a, b],
+	writeq(P), nl.
+
+:- initialization(main).
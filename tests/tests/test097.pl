@@ -0,0 +1,24 @@
+% The engine stacks grow in place for deep recursion and shrink back
+% afterwards, with everything still usable after each spike.
+
+len([], 0).
+len([_|T], N) :- len(T, N0), N is N0 + 1.
+
+mk(0, []) :- !.
+mk(N, [N|T]) :- N1 is N - 1, mk(N1, T).
+
+spike(N) :- mk(N, L), len(L, Len), write(Len), nl, fail.
+spike(_).
+
+deep(0, []) :- !.
+deep(N, [X|Xs]) :- N1 is N - 1, member(X, [a,b]), deep(N1, Xs).
+
+main :-
+	spike(500000),
+	spike(1000),
+	spike(500000),
+	once((deep(200000, L), last(L, b))), length(L, Len), write(Len), nl,
+	spike(1000),
+	deep(3, L3), write(L3), nl.
+
+:- initialization(main).
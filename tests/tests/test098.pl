@@ -0,0 +1,26 @@
+% An if-then-else whose condition is only type tests and comparisons
+% runs without a choice point, with the same results, errors and cuts.
+
+cls(X, Y) :-
+	(	var(X) -> Y = none
+	;	X > 5 -> Y = big
+	;	integer(X), X >= 2 -> Y = mid
+	;	Y = small
+	).
+
+first(L, X) :- member(X, L), ( X @> b -> ! ; true ).
+
+only(X) :- ( atom(X) -> true ).
+
+err(X, R) :- catch(( X > 1 -> R = yes ; R = no ), error(E, _), R = E).
+
+gen(X, Y) :- ( X == a -> member(Y, [1,2]) ; member(Y, [3,4]) ).
+
+main :-
+	findall(X-Y, (member(X, [9,3,1]), cls(X, Y)), L1), cls(_, N), write(L1-N), nl,
+	findall(X, first([a,b,c,d], X), L2), write(L2), nl,
+	findall(X, (member(X, [a,1,"s"]), only(X)), L3), write(L3), nl,
+	err(_, R1), err(foo, R2), err(2, R3), write([R1,R2,R3]), nl,
+	findall(Y, gen(a, Y), L4), findall(Y, gen(b, Y), L5), write(L4-L5), nl.
+
+:- initialization(main).
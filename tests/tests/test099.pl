@@ -0,0 +1,27 @@
+% Clause heads are matched by the compiled head unifier, which must
+% agree with the general one: repeated variables, strings against
+% lists, bigints, floats, attributed variables and occurs check.
+
+p(a, X, [X|_]).
+p(f(Y, Y), Y, g).
+p(1, "ab", [a|T]) :- T = [b].
+p(123456789012345678901234567890, 1.5, big).
+p(Z, Z, Z).
+
+q(s(A), A).
+
+main :-
+	findall(A-B-C, p(A, B, C), L1), length(L1, N1), write(N1), nl,
+	findall(B, p(a, B, [x, y]), L2), writeq(L2), nl,
+	findall(Y, p(f(1, Y), _, g), L3), writeq(L3), nl,
+	findall(V, (p(f(1, V), 2, g) ; V = none), L4), writeq(L4), nl,
+	findall(S-T, p(1, S, T), L5), writeq(L5), nl,
+	findall(X, p(1, [a,b], X), L6), writeq(L6), nl,
+	findall(X, p(123456789012345678901234567890, X, _), L7), writeq(L7), nl,
+	findall(X, (p(_, 1.5, X), ground(X)), L8), writeq(L8), nl,
+	freeze(F, (write(woken(F)), nl)), ( p(a, 7, [F]) -> true ; true ),
+	( q(W, W) -> writeq(cyclic) ; writeq(none) ), nl,
+	set_prolog_flag(occurs_check, true),
+	( q(W2, W2) -> writeq(W2) ; writeq(occurs) ), nl.
+
+:- initialization(main).
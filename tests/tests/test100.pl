@@ -0,0 +1,36 @@
+% Integer expressions are worked out without the general evaluator,
+% which must still be used for overflow, zero divisors, floats and
+% bigints, giving the same results and errors.
+
+add(X, Y, Z) :- Z is X + Y.
+mul(X, Y, Z) :- Z is X * Y.
+neg(X, Z) :- Z is -X.
+div(X, Y, Z) :- catch(Z is X // Y, error(E, _), Z = E).
+rem(X, Y, Z) :- catch(Z is X rem Y, error(E, _), Z = E).
+lt(X, Y) :- X + 1 < Y * 2.
+chk(X, Y, R) :- catch(( X - 1 =:= Y -> R = eq ; R = ne ), error(E, _), R = E).
+
+main :-
+	add(9223372036854775807, 1, A1), write(A1), nl,
+	add(1.5, 2, A2), write(A2), nl,
+	add(-3, 4, A3), write(A3), nl,
+	mul(4294967296, 4294967296, M1), write(M1), nl,
+	mul(123456789012345678901234567890, 2, M2), write(M2), nl,
+	neg(-9223372036854775808, N1), write(N1), nl,
+	neg(5, N2), write(N2), nl,
+	div(7, -2, D1), write(D1), nl,
+	div(-7, 2, D2), write(D2), nl,
+	div(7, 0, D3), write(D3), nl,
+	div(-9223372036854775808, -1, D4), write(D4), nl,
+	rem(-7, 2, R1), write(R1), nl,
+	rem(7, 0, R2), write(R2), nl,
+	rem(5, -1, R3), write(R3), nl,
+	findall(X-Y, (member(X-Y, [1-1, 1-2, 3-2, 0.5-1]), lt(X, Y)), L), write(L), nl,
+	chk(3, 2, C1), write(C1), nl,
+	chk(3, 2.0, C2), write(C2), nl,
+	chk(_, 2, C3), write(C3), nl,
+	chk(a, 2, C4), write(C4), nl,
+	( 6 is 2 * 3 -> write(yes) ; write(no) ), nl,
+	( 6.0 is 2 * 3 -> write(yes) ; write(no) ), nl.
+
+:- initialization(main).
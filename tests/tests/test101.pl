@@ -0,0 +1,24 @@
+% Atoms are interned in a hash table and keep their lengths in bytes
+% and characters. Functor names interned many times over must still be
+% the same atom, and lengths must be right for UTF-8 names.
+
+mk(N, F) :-
+	number_codes(N, Cs),
+	atom_codes(A, [0'f, 0'_|Cs]),
+	functor(T, A, 1),
+	functor(T, F, _).
+
+main :-
+	findall(F, (between(1, 20000, N), mk(N, F)), L1),
+	findall(F, (between(1, 20000, N), mk(N, F)), L2),
+	( L1 == L2 -> write(same) ; write(different) ), nl,
+	sort(L1, S1), length(S1, Len1), write(Len1), nl,
+	mk(12345, F1), atom_concat(f_, '12345', F2),
+	( F1 == F2 -> write(eq) ; write(ne) ), nl,
+	atom_length('héllo wörld', N1), write(N1), nl,
+	atom_length('日本語', N2), write(N2), nl,
+	atom_length('', N3), write(N3), nl,
+	sub_atom('日本語です', 2, 2, A2, Sub), writeq(Sub-A2), nl,
+	atom_codes(X, [0'a, 0'b]), atom_length(X, N4), write(N4), nl.
+
+:- initialization(main).
@@ -0,0 +1,35 @@
+% Atoms no longer referenced are reclaimed, while those held in the
+% database, in bindings or in a findall result keep their names.
+
+:- dynamic(kept/2).
+
+mk(P, N, F) :-
+	number_codes(N, Cs),
+	atom_codes(P, Ps),
+	append(Ps, Cs, Codes),
+	atom_codes(A, Codes),
+	functor(T, A, 1),
+	functor(T, F, _).
+
+churn(0) :- !.
+churn(N) :- mk(tmp_, N, _), N1 is N-1, churn(N1).
+
+main :-
+	findall(A, (between(1, 500, I), mk(held_, I, A)), Held),
+	forall(between(1, 500, I), (mk(db_, I, A), assertz(kept(I, A)))),
+	mk(local_, 42, Local),
+	churn(20000),
+	garbage_collect_atoms,
+	churn(20000),
+	statistics(atoms, [_, _, G, F]),
+	write(Local), nl,
+	findall(A, (between(1, 500, I), mk(held_, I, A)), Held2),
+	(Held == Held2 -> write(held_ok) ; write(held_bad)), nl,
+	(forall(kept(I, A), mk(db_, I, A)) -> write(db_ok) ; write(db_bad)), nl,
+	(G > 0 -> write(collected) ; write(G)), nl,
+	(F >= 20000 -> write(reclaimed) ; write(F)), nl,
+	Held2 = [H1|_], last(Held2, H2),
+	write(H1-H2), nl,
+	atom_length(Local, L), write(L), nl.
+
+:- initialization(main).
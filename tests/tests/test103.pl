@@ -0,0 +1,32 @@
+% Atoms are compared by a cached rank once they have been ranked, and
+% by name before that, which must give the same order either way.
+
+mk(N, F) :-
+	number_codes(N, Cs),
+	atom_codes(A, [0'k|Cs]),
+	functor(T, A, 1),
+	functor(T, F, _).
+
+by_codes([]).
+by_codes([_]).
+by_codes([A,B|Rest]) :-
+	atom_codes(A, As), atom_codes(B, Bs),
+	As @< Bs,
+	by_codes([B|Rest]).
+
+main :-
+	msort([pear, apple, zebra, apple_pie, app, zed, e, z, 'Apple'], S1),
+	write(S1), nl,
+	findall(A, (between(1, 3000, N), M is (N * 7919) mod 3001, mk(M, A)), L1),
+	sort(L1, S2),
+	(by_codes(S2) -> write(ranked_ok) ; write(ranked_bad)), nl,
+	findall(A, (between(1, 500, N), M is N + 5000, mk(M, A)), L2),
+	append(L2, S2, L3),
+	sort(L3, S3),
+	(by_codes(S3) -> write(mixed_ok) ; write(mixed_bad)), nl,
+	length(S3, Len), write(Len), nl,
+	compare(O1, k10, k9), compare(O2, k5001, k5001), compare(O3, k500, k5000),
+	write(O1), write(O2), write(O3), nl,
+	keysort([k2-a, k10-b, k2-c, k1-d], S4), write(S4), nl.
+
+:- initialization(main).
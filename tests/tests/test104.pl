@@ -0,0 +1,28 @@
+% Clauses asserted and retracted in bulk come from slabs, a clause too
+% big for a slab getting its own record, and the clauses left behind
+% are intact.
+
+:- dynamic(f/2).
+:- dynamic(g/1).
+
+fill(N) :-
+	forall(between(1, N, I), (J is I * I, assertz(f(I, J)))).
+
+main :-
+	statistics(clauses, [L0, B0, _, _]),
+	fill(1000),
+	statistics(clauses, [L1, _, S1, _]),
+	D1 is L1 - L0, write(D1), nl,
+	(S1 > 0 -> write(slabs) ; write(S1)), nl,
+	numlist(1, 40, Ns),
+	assertz(g(Ns)),
+	statistics(clauses, [_, B1, _, _]),
+	D2 is B1 - B0, write(D2), nl,
+	retractall(f(_, _)),
+	fill(500),
+	findall(J, f(_, J), Js), sum_list(Js, Sum), write(Sum), nl,
+	g(L), length(L, Len), write(Len), nl,
+	retract(f(10, X)), write(X), nl,
+	findall(I, f(I, _), Is), length(Is, C), write(C), nl.
+
+:- initialization(main).
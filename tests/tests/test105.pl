@@ -0,0 +1,32 @@
+% Heap pages dropped on backtracking are used again, and pages grow
+% when each pass needs more than one. Terms built on reused pages
+% are intact.
+
+mk(N, A) :-
+	length(L, N),
+	maplist(=(0'a), L),
+	atom_codes(A, L).
+
+pass(A) :-
+	atom_codes(A, Cs),
+	atom_codes(A, Ds),
+	atom_codes(A, Es),
+	length(Cs, N1),
+	length(Ds, N2),
+	length(Es, N3),
+	N1 + N2 + N3 =:= 15000.
+
+main :-
+	mk(5000, A),
+	statistics(pages, [_, _, N0, R0, S0]),
+	forall(between(1, 200, _), pass(A)),
+	statistics(pages, [_, _, N1, R1, S1]),
+	(N1 - N0 < 10 -> write(few_new) ; write(N1-N0)), nl,
+	(R1 - R0 > 100 -> write(reused) ; write(R1-R0)), nl,
+	(S1 > S0 -> write(grown) ; write(S1-S0)), nl,
+	findall(X, (between(1, 50, I), atom_codes(A, Cs), nth1(I, Cs, X)), Xs),
+	sort(Xs, Ys), write(Ys), nl,
+	atom_codes(A, Cs), atom_codes(C, [0'x|Cs]),
+	atom_length(C, Len), write(Len), nl.
+
+:- initialization(main).